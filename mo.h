@@ -0,0 +1,689 @@
+#ifndef MO_H
+#define MO_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <cstdlib>
+#include <thread>
+
+
+// query on half-open segment [l, r)
+struct MoQuery {
+    int l;
+    int r;
+};
+
+
+// block size minimizing q * B + n * n / B pointer moves
+inline int moBlockSize(int n, int q) {
+    if (q < 1) {
+        q = 1;
+    }
+    int b = (int)(n / std::sqrt((double)q));
+    return std::max(b, 1);
+}
+
+
+enum class MoOrder {
+    CLASSIC,    // (l / B, r)
+    ODD_EVEN,   // (l / B, r), r descending in odd blocks
+    HILBERT     // position of (l, r) on Hilbert curve
+};
+
+// distance of point (x, y) along Hilbert curve covering 2^pow x 2^pow square
+inline unsigned long long hilbertOrder(unsigned x, unsigned y, int pow) {
+    unsigned long long d = 0;
+    for (unsigned s = (1u << pow) >> 1; s > 0; s >>= 1) {
+        unsigned rx = (x & s) > 0;
+        unsigned ry = (y & s) > 0;
+        d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+
+        // rotate quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = ~x;
+                y = ~y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// LSD radix sort of (key, index) pairs by key, 16 bit digits.
+// Passes where all keys share the same digit are skipped.
+inline void moRadixSort(std::vector<std::pair<unsigned long long, int>> &a) {
+    const int BITS = 16;
+    const int BUCKETS = 1 << BITS;
+
+    std::vector<std::pair<unsigned long long, int>> tmp(a.size());
+    std::vector<int> count(BUCKETS + 1);
+
+    unsigned long long maxKey = 0;
+    for (auto &p : a) {
+        maxKey = std::max(maxKey, p.first);
+    }
+
+    for (int shift = 0; shift < 64 && (maxKey >> shift); shift += BITS) {
+        std::fill(count.begin(), count.end(), 0);
+        for (auto &p : a) {
+            count[((p.first >> shift) & (BUCKETS - 1)) + 1]++;
+        }
+
+        if (count[((a[0].first >> shift) & (BUCKETS - 1)) + 1] == (int)a.size()) {
+            continue;
+        }
+
+        for (int i = 0; i < BUCKETS; i++) {
+            count[i + 1] += count[i];
+        }
+        for (auto &p : a) {
+            tmp[count[(p.first >> shift) & (BUCKETS - 1)]++] = p;
+        }
+        a.swap(tmp);
+    }
+}
+
+// processing order of queries on array of size n
+inline std::vector<int> moOrder(int n, const std::vector<MoQuery> &queries, MoOrder kind) {
+    std::vector<int> result(queries.size());
+
+    if (kind == MoOrder::HILBERT) {
+        int pow = 0;
+        while ((1 << pow) <= n) {
+            pow++;
+        }
+
+        std::vector<std::pair<unsigned long long, int>> keys(queries.size());
+        for (int i = 0; i < (int)queries.size(); i++) {
+            keys[i] = std::make_pair(hilbertOrder(queries[i].l, queries[i].r, pow), i);
+        }
+
+        moRadixSort(keys);
+
+        for (int i = 0; i < (int)keys.size(); i++) {
+            result[i] = keys[i].second;
+        }
+        return result;
+    }
+
+    int blockSize = moBlockSize(n, queries.size());
+    bool oddEven = kind == MoOrder::ODD_EVEN;
+
+    for (int i = 0; i < (int)result.size(); i++) {
+        result[i] = i;
+    }
+
+    std::sort(result.begin(), result.end(), [&](int i, int j) {
+        const MoQuery &q1 = queries[i];
+        const MoQuery &q2 = queries[j];
+        int b1 = q1.l / blockSize;
+        int b2 = q2.l / blockSize;
+        if (b1 != b2) {
+            return b1 < b2;
+        }
+
+        if (oddEven && (b1 & 1)) {
+            return q1.r > q2.r;
+        }
+        return q1.r < q2.r;
+    });
+
+    return result;
+}
+
+// total left + right pointer moves made while processing queries in given order
+inline long long moPointerMoves(const std::vector<MoQuery> &queries, const std::vector<int> &order) {
+    long long moves = 0;
+    int l = 0;
+    int r = 0;
+    for (int i : order) {
+        moves += std::abs(queries[i].l - l) + std::abs(queries[i].r - r);
+        l = queries[i].l;
+        r = queries[i].r;
+    }
+    return moves;
+}
+
+
+// Mo's algorithm for offline range queries.
+//
+// Policy holds the state of the current window and must provide:
+//     typedef ... Value;                // element type of the data array
+//     typedef ... Result;               // answer type
+//     void add(const Value &v);         // v enters the window
+//     void remove(const Value &v);      // v leaves the window
+//     Result answer() const;            // answer for the current window
+//
+// Answers are written to an output vector indexed by query number,
+// caller's queries are never reordered.
+template <typename Policy>
+class Mo {
+public:
+    typedef typename Policy::Value Value;
+    typedef typename Policy::Result Result;
+
+private:
+    const std::vector<Value> &mData;
+    Policy mPolicy;
+
+    int mBegin = 0;
+    int mEnd = 0;
+
+public:
+    Mo(const std::vector<Value> &data, const Policy &policy = Policy()) : mData(data), mPolicy(policy) {
+    }
+
+    Policy &policy() {
+        return mPolicy;
+    }
+
+    int begin() const {
+        return mBegin;
+    }
+
+    int end() const {
+        return mEnd;
+    }
+
+    // places empty window at pos, current window must be empty
+    void reset(int pos) {
+        assert(mBegin == mEnd);
+        mBegin = pos;
+        mEnd = pos;
+    }
+
+    // moves current window to [l, r)
+    inline void move(int l, int r) {
+        assert(l >= 0 && l <= r && r <= (int)mData.size());
+
+        while (mEnd < r) {
+            mPolicy.add(mData[mEnd]);
+            mEnd++;
+        }
+
+        while (mBegin > l) {
+            mBegin--;
+            mPolicy.add(mData[mBegin]);
+        }
+
+        while (mBegin < l) {
+            mPolicy.remove(mData[mBegin]);
+            mBegin++;
+        }
+
+        while (mEnd > r) {
+            mEnd--;
+            mPolicy.remove(mData[mEnd]);
+        }
+    }
+
+    void answer(const std::vector<MoQuery> &queries, std::vector<Result> &out, MoOrder kind = MoOrder::HILBERT) {
+        out.resize(queries.size());
+
+        std::vector<int> ord = moOrder(mData.size(), queries, kind);
+        for (int i : ord) {
+            move(queries[i].l, queries[i].r);
+            out[i] = mPolicy.answer();
+        }
+    }
+
+    std::vector<Result> answer(const std::vector<MoQuery> &queries, MoOrder kind = MoOrder::HILBERT) {
+        std::vector<Result> out;
+        answer(queries, out, kind);
+        return out;
+    }
+};
+
+
+// Parallel Mo: sorted queries are split into contiguous chunks, one per thread,
+// each thread owns a copy of initial policy and its own window.
+// Chunk bounds balance pointer moves between neighbouring queries,
+// window rebuild at chunk start (at most n moves) is not counted.
+// Result must not be bool: threads write neighbouring elements of out.
+template <typename Policy>
+void moParallel(const std::vector<typename Policy::Value> &data, const std::vector<MoQuery> &queries,
+                std::vector<typename Policy::Result> &out, int threads, const Policy &policy = Policy(),
+                MoOrder kind = MoOrder::HILBERT) {
+    out.resize(queries.size());
+
+    std::vector<int> order = moOrder(data.size(), queries, kind);
+    int q = order.size();
+    threads = std::max(1, std::min(threads, q));
+
+    // moves[i] - pointer moves made by sequential sweep before answering order[0..i)
+    std::vector<long long> moves(q + 1);
+    for (int i = 0; i < q; i++) {
+        const MoQuery &cur = queries[order[i]];
+        const MoQuery &prev = i ? queries[order[i - 1]] : cur;
+        long long step = i ? std::abs(cur.l - prev.l) + std::abs(cur.r - prev.r) : cur.r - cur.l;
+        moves[i + 1] = moves[i] + step;
+    }
+
+    std::vector<int> bounds(threads + 1);
+    bounds[threads] = q;
+    for (int t = 1; t < threads; t++) {
+        long long target = moves[q] * t / threads;
+        int b = std::lower_bound(moves.begin(), moves.end(), target) - moves.begin();
+        bounds[t] = std::max(bounds[t - 1], std::min(b, q));
+    }
+
+    auto work = [&](int from, int to) {
+        if (from == to) {
+            return;
+        }
+        Mo<Policy> mo(data, policy);
+        mo.reset(queries[order[from]].l);
+        for (int i = from; i < to; i++) {
+            const MoQuery &query = queries[order[i]];
+            mo.move(query.l, query.r);
+            out[order[i]] = mo.policy().answer();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++) {
+        workers.push_back(std::thread(work, bounds[t], bounds[t + 1]));
+    }
+    work(bounds[0], bounds[1]);
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+
+// query on segment [l, r) after first t updates were applied
+struct MoTimedQuery {
+    int l;
+    int r;
+    int t;
+};
+
+// point update: data[pos] = value
+template <typename Value>
+struct MoUpdate {
+    int pos;
+    Value value;
+};
+
+// block size minimizing q * B + n * n * u / (B * B) moves
+inline int moUpdatesBlockSize(int n, int q, int u) {
+    q = std::max(q, 1);
+    u = std::max(u, 1);
+    int b = (int)std::cbrt(2.0 * n * n * u / q);
+    return std::max(std::min(b, n), 1);
+}
+
+
+// Mo's algorithm with point updates: queries are ordered by (l / B, r / B, t)
+// and the window additionally moves along time axis.
+// Uses the same Policy as Mo.
+template <typename Policy>
+class MoWithUpdates {
+public:
+    typedef typename Policy::Value Value;
+    typedef typename Policy::Result Result;
+
+private:
+    std::vector<Value> mData;
+    std::vector<MoUpdate<Value>> mUpdates;
+    Mo<Policy> mMo;
+    int mTime = 0;
+
+    // swaps stored value with array value, so the same call undoes itself
+    inline void swapUpdate(int t) {
+        MoUpdate<Value> &u = mUpdates[t];
+        if (u.pos >= mMo.begin() && u.pos < mMo.end()) {
+            mMo.policy().remove(mData[u.pos]);
+            mMo.policy().add(u.value);
+        }
+        std::swap(mData[u.pos], u.value);
+    }
+
+public:
+    MoWithUpdates(const std::vector<Value> &data, const std::vector<MoUpdate<Value>> &updates, const Policy &policy = Policy())
+        : mData(data), mUpdates(updates), mMo(mData, policy) {
+    }
+
+    MoWithUpdates(const MoWithUpdates &) = delete;
+    MoWithUpdates &operator=(const MoWithUpdates &) = delete;
+
+    // applies update number mTime
+    inline void applyUpdate() {
+        swapUpdate(mTime++);
+    }
+
+    // reverts update number mTime - 1
+    inline void undoUpdate() {
+        swapUpdate(--mTime);
+    }
+
+    void answer(const std::vector<MoTimedQuery> &queries, std::vector<Result> &out) {
+        out.resize(queries.size());
+
+        int blockSize = moUpdatesBlockSize(mData.size(), queries.size(), mUpdates.size());
+
+        std::vector<int> order(queries.size());
+        for (int i = 0; i < (int)order.size(); i++) {
+            order[i] = i;
+        }
+
+        std::sort(order.begin(), order.end(), [&](int i, int j) {
+            const MoTimedQuery &q1 = queries[i];
+            const MoTimedQuery &q2 = queries[j];
+            if (q1.l / blockSize != q2.l / blockSize) {
+                return q1.l / blockSize < q2.l / blockSize;
+            }
+            if (q1.r / blockSize != q2.r / blockSize) {
+                return q1.r / blockSize < q2.r / blockSize;
+            }
+            return q1.t < q2.t;
+        });
+
+        for (int i : order) {
+            const MoTimedQuery &q = queries[i];
+            assert(q.t >= 0 && q.t <= (int)mUpdates.size());
+
+            while (mTime < q.t) {
+                applyUpdate();
+            }
+            while (mTime > q.t) {
+                undoUpdate();
+            }
+
+            mMo.move(q.l, q.r);
+            out[i] = mMo.policy().answer();
+        }
+    }
+
+    std::vector<Result> answer(const std::vector<MoTimedQuery> &queries) {
+        std::vector<Result> out;
+        answer(queries, out);
+        return out;
+    }
+};
+
+
+// query on tree path u - v, both ends included
+struct MoPathQuery {
+    int u;
+    int v;
+};
+
+// Mo's algorithm on tree paths. Tree is flattened by Euler tour where every
+// node appears twice (on enter and on exit), path u - v becomes tour segment
+// where nodes of the path appear once and all others twice or never.
+// LCA is outside of that segment unless it is one of the ends, so it is
+// added separately. Uses the same Policy as Mo.
+template <typename Policy>
+class TreeMo {
+public:
+    typedef typename Policy::Value Value;
+    typedef typename Policy::Result Result;
+
+private:
+    // adapts Policy to tour: second occurrence of the node cancels the first one
+    struct Toggle {
+        typedef int Value;
+        typedef typename Policy::Result Result;
+
+        const std::vector<typename Policy::Value> *mValues;
+        std::vector<char> mInside;
+        Policy mPolicy;
+
+        Toggle(const std::vector<typename Policy::Value> *values, const Policy &policy)
+            : mValues(values), mInside(values->size()), mPolicy(policy) {
+        }
+
+        inline void toggle(int node) {
+            if (mInside[node]) {
+                mPolicy.remove((*mValues)[node]);
+            } else {
+                mPolicy.add((*mValues)[node]);
+            }
+            mInside[node] ^= 1;
+        }
+
+        inline void add(int node) {
+            toggle(node);
+        }
+
+        inline void remove(int node) {
+            toggle(node);
+        }
+
+        inline Result answer() const {
+            return mPolicy.answer();
+        }
+    };
+
+    std::vector<Value> mValues;
+    std::vector<int> mTour;
+    std::vector<int> mIn;
+    std::vector<int> mOut;
+    std::vector<int> mDepth;
+    std::vector<std::vector<int>> mUp; // binary lifting table
+    Mo<Toggle> mMo;
+
+    void build(const std::vector<std::vector<int>> &adjacency, int root) {
+        int n = mValues.size();
+        if (!n) { // empty tree, no paths to answer
+            return;
+        }
+        mTour.reserve(2 * n);
+
+        int log = 1;
+        while ((1 << log) < n) {
+            log++;
+        }
+        mUp.assign(log, std::vector<int>(n, root));
+
+        // iterative dfs, stack of (node, next child index)
+        std::vector<std::pair<int, int>> stack;
+        stack.push_back(std::make_pair(root, 0));
+        mIn[root] = mTour.size();
+        mTour.push_back(root);
+
+        while (!stack.empty()) {
+            int v = stack.back().first;
+            int &next = stack.back().second;
+
+            if (next < (int)adjacency[v].size()) {
+                int to = adjacency[v][next++];
+                if (to == mUp[0][v] && v != root) {
+                    continue;
+                }
+                mUp[0][to] = v;
+                mDepth[to] = mDepth[v] + 1;
+                mIn[to] = mTour.size();
+                mTour.push_back(to);
+                stack.push_back(std::make_pair(to, 0));
+            } else {
+                mOut[v] = mTour.size();
+                mTour.push_back(v);
+                stack.pop_back();
+            }
+        }
+
+        for (int k = 1; k < log; k++) {
+            for (int v = 0; v < n; v++) {
+                mUp[k][v] = mUp[k - 1][mUp[k - 1][v]];
+            }
+        }
+    }
+
+public:
+    // adjacency lists of undirected tree, values of nodes
+    TreeMo(const std::vector<std::vector<int>> &adjacency, const std::vector<Value> &values, int root = 0, const Policy &policy = Policy())
+        : mValues(values), mIn(values.size()), mOut(values.size()), mDepth(values.size()), mMo(mTour, Toggle(&mValues, policy)) {
+        assert(adjacency.size() == values.size());
+        build(adjacency, root);
+    }
+
+    TreeMo(const TreeMo &) = delete;
+    TreeMo &operator=(const TreeMo &) = delete;
+
+    int lca(int u, int v) const {
+        if (mDepth[u] < mDepth[v]) {
+            std::swap(u, v);
+        }
+
+        int diff = mDepth[u] - mDepth[v];
+        for (int k = 0; diff; k++, diff >>= 1) {
+            if (diff & 1) {
+                u = mUp[k][u];
+            }
+        }
+
+        if (u == v) {
+            return u;
+        }
+
+        for (int k = mUp.size() - 1; k >= 0; k--) {
+            if (mUp[k][u] != mUp[k][v]) {
+                u = mUp[k][u];
+                v = mUp[k][v];
+            }
+        }
+        return mUp[0][u];
+    }
+
+    void answer(const std::vector<MoPathQuery> &queries, std::vector<Result> &out, MoOrder kind = MoOrder::HILBERT) {
+        out.resize(queries.size());
+
+        std::vector<MoQuery> segments(queries.size());
+        std::vector<int> extra(queries.size(), -1);
+
+        for (int i = 0; i < (int)queries.size(); i++) {
+            int u = queries[i].u;
+            int v = queries[i].v;
+            if (mIn[u] > mIn[v]) {
+                std::swap(u, v);
+            }
+
+            int w = lca(u, v);
+            if (w == u) {
+                segments[i].l = mIn[u];
+            } else {
+                segments[i].l = mOut[u];
+                extra[i] = w;
+            }
+            segments[i].r = mIn[v] + 1;
+        }
+
+        Policy &policy = mMo.policy().mPolicy;
+        std::vector<int> order = moOrder(mTour.size(), segments, kind);
+        for (int i : order) {
+            mMo.move(segments[i].l, segments[i].r);
+
+            if (extra[i] >= 0) {
+                policy.add(mValues[extra[i]]);
+                out[i] = policy.answer();
+                policy.remove(mValues[extra[i]]);
+            } else {
+                out[i] = policy.answer();
+            }
+        }
+    }
+
+    std::vector<Result> answer(const std::vector<MoPathQuery> &queries, MoOrder kind = MoOrder::HILBERT) {
+        std::vector<Result> out;
+        answer(queries, out, kind);
+        return out;
+    }
+};
+
+
+// ready-made policies, values are expected to be compressed into [0, maxValue)
+
+// number of distinct values in the window
+struct MoDistinctCount {
+    typedef int Value;
+    typedef int Result;
+
+    std::vector<int> mCount;
+    int mDistinct = 0;
+
+    MoDistinctCount(int maxValue = 0) : mCount(maxValue) {}
+
+    inline void add(int v) {
+        if (mCount[v]++ == 0) {
+            mDistinct++;
+        }
+    }
+
+    inline void remove(int v) {
+        if (--mCount[v] == 0) {
+            mDistinct--;
+        }
+    }
+
+    inline int answer() const {
+        return mDistinct;
+    }
+};
+
+// frequency of the most frequent value in the window
+struct MoModeFrequency {
+    typedef int Value;
+    typedef int Result;
+
+    std::vector<int> mCount;        // occurrences of value
+    std::vector<int> mCountOfCount; // number of values with given occurrences
+    int mBest = 0;
+
+    MoModeFrequency(int maxValue = 0) : mCount(maxValue), mCountOfCount(1) {}
+
+    inline void add(int v) {
+        int c = mCount[v]++;
+        mCountOfCount[c]--;
+        if (c + 1 == (int)mCountOfCount.size()) {
+            mCountOfCount.push_back(0);
+        }
+        mCountOfCount[c + 1]++;
+        mBest = std::max(mBest, c + 1);
+    }
+
+    inline void remove(int v) {
+        int c = mCount[v]--;
+        if (c == mBest && mCountOfCount[c] == 1) {
+            mBest--;
+        }
+        mCountOfCount[c]--;
+        mCountOfCount[c - 1]++;
+    }
+
+    inline int answer() const {
+        return mBest;
+    }
+};
+
+// sum of squared occurrences of every value in the window
+struct MoSumOfSquares {
+    typedef int Value;
+    typedef long long Result;
+
+    std::vector<int> mCount;
+    long long mSum = 0;
+
+    MoSumOfSquares(int maxValue = 0) : mCount(maxValue) {}
+
+    inline void add(int v) {
+        // (c + 1)^2 - c^2 = 2c + 1
+        mSum += 2 * mCount[v]++ + 1;
+    }
+
+    inline void remove(int v) {
+        mSum -= 2 * --mCount[v] + 1;
+    }
+
+    inline long long answer() const {
+        return mSum;
+    }
+};
+
+
+#endif // MO_H
@@ -1,92 +1,157 @@
 #include <iostream>
 #include <algorithm>
 #include <vector>
+#include <cassert>
+#include <chrono>
+#include <random>
 
+#include "mo.h"
 
 using namespace std;
 
-struct Query {
-    int l; // left query-segment bound
-    int r; // right query-segment bound (not included)
-    int number; // this field is used to restore inintial query order
 
-    // add your fields here
-    int result;
-};
+void testUpdates() {
+    mt19937 rnd(1);
+    int n = 300;
+    int values = 20;
 
-
-struct Mo {
-    vector<int> votesForId;
-    vector<int> idsVorVote;
-
-    void addItem(int item) {
-        // add item to current segment
+    vector<int> data(n);
+    for (int &v : data) {
+        v = rnd() % values;
     }
 
-    void removeItem(int item) {
-        // remove item from current segment
+    vector<MoUpdate<int>> updates;
+    vector<MoTimedQuery> queries;
+    vector<int> expected;
+
+    vector<int> current = data;
+    for (int i = 0; i < 500; i++) {
+        if (rnd() % 2) {
+            MoUpdate<int> u = {int(rnd() % n), int(rnd() % values)};
+            updates.push_back(u);
+            current[u.pos] = u.value;
+        } else {
+            int a = rnd() % (n + 1);
+            int b = rnd() % (n + 1);
+            MoTimedQuery q = {min(a, b), max(a, b), (int)updates.size()};
+            queries.push_back(q);
+
+            vector<int> window(current.begin() + q.l, current.begin() + q.r);
+            sort(window.begin(), window.end());
+            expected.push_back(unique(window.begin(), window.end()) - window.begin());
+        }
     }
-    
-    void saveResult(Query &q) {
-        // save result for current segment (current query)
+
+    MoWithUpdates<MoDistinctCount> mo(data, updates, MoDistinctCount(values));
+    assert(mo.answer(queries) == expected);
+
+    cout << "updates passed" << endl;
+}
+
+void testTree() {
+    mt19937 rnd(2);
+    int n = 200;
+    int values = 10;
+
+    vector<int> data(n);
+    vector<int> parent(n, -1);
+    vector<vector<int>> adjacency(n);
+    for (int v = 0; v < n; v++) {
+        data[v] = rnd() % values;
+        if (v) {
+            parent[v] = rnd() % v;
+            adjacency[v].push_back(parent[v]);
+            adjacency[parent[v]].push_back(v);
+        }
     }
-    
-
-    Mo(vector<int> &data, vector<Query> &queries) {
-        sort(queries.begin(), queries.end(),
-             [=](const Query& q1, const Query& q2)
-        {
-            if (q1.l / blockSize != q2.l / blockSize) {
-                return q1.l / blockSize < q2.l / blockSize;
-            }
 
-            return q1.r < q2.r;
-        });
+    vector<MoPathQuery> queries;
+    vector<int> expected;
+    for (int i = 0; i < 300; i++) {
+        MoPathQuery q = {int(rnd() % n), int(rnd() % n)};
+        queries.push_back(q);
 
-        int begin = 0;
-        int end = 0;
-        // do the job
-        for (int i = 0; i < (int)queries.size(); i++) {
-            int qBegin = queries[i].l;
-            int qEnd = queries[i].r;
+        // path by walking up from both ends
+        vector<int> onPath(n);
+        for (int v = q.u; v >= 0; v = parent[v]) {
+            onPath[v] ^= 1;
+        }
+        for (int v = q.v; v >= 0; v = parent[v]) {
+            onPath[v] ^= 1;
+        }
+        int lca = q.u;
+        while (lca >= 0 && onPath[lca]) {
+            lca = parent[lca];
+        }
+        onPath[lca] = 1;
 
-            while (end < qEnd) {
-                addItem(data[end]);
-                end++;
-            }
-            
-            while (begin < qBegin) {
-                removeItem(data[begin]);
-                begin++;
+        vector<int> count(values);
+        int distinct = 0;
+        for (int v = 0; v < n; v++) {
+            if (onPath[v] && count[data[v]]++ == 0) {
+                distinct++;
             }
+        }
+        expected.push_back(distinct);
+    }
 
-            while (begin > qBegin) {
-                begin--;
-                addItem(data[begin]);
-            }
+    TreeMo<MoDistinctCount> mo(adjacency, data, 0, MoDistinctCount(values));
+    assert(mo.answer(queries) == expected);
 
-            while (end > qEnd) {
-                end--;
-                removeItem(data[end]);
-            }
+    cout << "tree passed" << endl;
+}
 
-            saveResult(queries[i]);
+void benchmark(int n, int q) {
+    mt19937 rnd(42);
+    vector<int> data(n);
+    for (int &v : data) {
+        v = rnd() % n;
+    }
+
+    vector<MoQuery> queries(q);
+    for (MoQuery &query : queries) {
+        int a = rnd() % (n + 1);
+        int b = rnd() % (n + 1);
+        query.l = min(a, b);
+        query.r = max(a, b);
+    }
+
+    const char *names[] = {"classic", "odd-even", "hilbert"};
+    MoOrder kinds[] = {MoOrder::CLASSIC, MoOrder::ODD_EVEN, MoOrder::HILBERT};
+
+    vector<int> reference;
+    for (int k = 0; k < 3; k++) {
+        long long moves = moPointerMoves(queries, moOrder(n, queries, kinds[k]));
+
+        auto start = chrono::steady_clock::now();
+        Mo<MoDistinctCount> mo(data, MoDistinctCount(n));
+        vector<int> result = mo.answer(queries, kinds[k]);
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+        if (k == 0) {
+            reference = result;
         }
+        assert(result == reference);
 
-        sort(queries.begin(), queries.end(),
-             [](const Query &q1, const Query &q2) {
-            return q1.number < q2.number;
-        });
-        
+        cout << names[k] << ":\tmoves " << moves << "\ttime " << elapsed.count() << " ms" << endl;
     }
-};
+
+    for (int threads = 1; threads <= (int)thread::hardware_concurrency() * 2; threads *= 2) {
+        auto start = chrono::steady_clock::now();
+        vector<int> result;
+        moParallel(data, queries, result, threads, MoDistinctCount(n));
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+        assert(result == reference);
+
+        cout << "hilbert, " << threads << " threads:\ttime " << elapsed.count() << " ms" << endl;
+    }
+}
 
 int main(int argc, char *argv[])
 {
-    cout << "Hello World!" << endl;
-
     vector<int> data = {0, 2, 5, 1, 7, 9, 0, 4, 2, 8};
-    vector<Query> queries = {
+    vector<MoQuery> queries = {
         {1, 2},
         {0, 9},
         {8, 9},
@@ -94,11 +159,26 @@ int main(int argc, char *argv[])
         {4, 6}
     };
 
-    Mo mo(data, queries);
+    Mo<MoDistinctCount> mo(data, MoDistinctCount(10));
+    vector<int> distinct = mo.answer(queries);
+
+    Mo<MoModeFrequency> modeMo(data, MoModeFrequency(10));
+    vector<int> mode = modeMo.answer(queries);
+
+    Mo<MoSumOfSquares> squaresMo(data, MoSumOfSquares(10));
+    vector<long long> squares = squaresMo.answer(queries);
 
     for (int i = 0; i < (int)queries.size(); i++) {
-        cout << "[" << queries[i].first << "-" << queries[i].second << ") - " << queries[i].result << endl;
+        cout << "[" << queries[i].l << "-" << queries[i].r << ") - " << distinct[i] << " " << mode[i] << " " << squares[i] << endl;
     }
 
+    assert(distinct == vector<int>({1, 7, 1, 6, 2}));
+    assert(mode == vector<int>({1, 2, 1, 1, 1}));
+    assert(squares == vector<long long>({1, 13, 1, 6, 2}));
+
+    testUpdates();
+    testTree();
+    benchmark(200000, 200000);
+
     return 0;
 }
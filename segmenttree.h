@@ -2,167 +2,1154 @@
 #include <algorithm>
 #include <vector>
 #include <limits>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstdint>
+#include <cassert>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
 
-class SegmentTree {
+// Monoids: associative combine with identity element.
+// repeat(x, k) is combine of k copies of x, it lets actions that act on every
+// element of a segment update aggregate of the whole segment at once.
 
-public:
+template <typename T>
+struct SumMonoid {
+    typedef T Value;
+    static inline T identity() { return T(0); }
+    static inline T combine(const T &a, const T &b) { return a + b; }
+    static inline T repeat(const T &x, int k) { return x * k; }
+};
 
-    struct Node {
-        int min;
+template <typename T>
+struct MinMonoid {
+    typedef T Value;
+    static inline T identity() { return numeric_limits<T>::max(); }
+    static inline T combine(const T &a, const T &b) { return min(a, b); }
+    static inline T repeat(const T &x, int) { return x; }
+};
+
+template <typename T>
+struct MaxMonoid {
+    typedef T Value;
+    static inline T identity() { return numeric_limits<T>::lowest(); }
+    static inline T combine(const T &a, const T &b) { return max(a, b); }
+    static inline T repeat(const T &x, int) { return x; }
+};
+
+
+// Actions: lazy range updates.
+//     compose(newer, older)        - tag equal to applying older, then newer
+//     apply<Monoid>(tag, x, size)  - aggregate x of size elements after tag
+// Tree keeps separate "has pending" flag, so actions need no identity tag
+// and every tag value (e.g. assignment of 0) is a real update.
+
+// x += tag
+template <typename T>
+struct AddAction {
+    typedef T Tag;
+    static inline Tag compose(const Tag &newer, const Tag &older) { return newer + older; }
+
+    template <typename Monoid>
+    static inline T apply(const Tag &tag, const T &x, int size) {
+        return x + Monoid::repeat(tag, size);
+    }
+};
+
+// x = a * x + b, for min/max a must not be negative
+template <typename T>
+struct AffineAction {
+    struct Tag {
+        T a;
+        T b;
+    };
+
+    static inline Tag compose(const Tag &newer, const Tag &older) {
+        return Tag{newer.a * older.a, newer.a * older.b + newer.b};
+    }
+
+    template <typename Monoid>
+    static inline T apply(const Tag &tag, const T &x, int size) {
+        return tag.a * x + Monoid::repeat(tag.b, size);
+    }
+};
+
+// x = tag
+template <typename T>
+struct AssignAction {
+    typedef T Tag;
+    static inline Tag compose(const Tag &newer, const Tag &) { return newer; }
+
+    template <typename Monoid>
+    static inline T apply(const Tag &tag, const T &, int size) {
+        return Monoid::repeat(tag, size);
+    }
+};
+
+
+// Lazy segment tree over arbitrary monoid and action.
+// Heap layout, node v has children 2v and 2v + 1, node bounds are passed
+// down the recursion, so nodes store only aggregate and pending tag.
+template <typename Monoid, typename Action>
+class SegmentTree {
+public:
+    typedef typename Monoid::Value Value;
+    typedef typename Action::Tag Tag;
 
-        int pending = 0;
+    struct Update {
         int from;
         int to;
+        Tag tag;
+    };
+
+private:
+    vector<Value> mValue;
+    vector<Tag> mPending;
+    vector<char> mHasPending;
+    int mSize;
 
-        inline int size() {
-            return to - from + 1;
+    vector<vector<int>> mBatch; // per depth lists of update ids for batch update
+
+    inline void change(int v, const Tag &tag, int size) {
+        mValue[v] = Action::template apply<Monoid>(tag, mValue[v], size);
+        if (mHasPending[v]) {
+            mPending[v] = Action::compose(tag, mPending[v]);
+        } else {
+            mPending[v] = tag;
+            mHasPending[v] = true;
         }
-    };
+    }
 
+    inline void propagate(int v, int from, int mid, int to) {
+        if (mHasPending[v]) {
+            change(2 * v, mPending[v], mid - from + 1);
+            change(2 * v + 1, mPending[v], to - mid);
+            mHasPending[v] = false;
+        }
+    }
 
-private:
-    vector<Node> mHeap;
-    vector<int> mArray;
-
-    static inline int prevPow2(int i) {
-#if 0
-        int p = 1 << (31 - __builtin_clz(i));
-        return (p == i ? p / 2 : p);
-#else
-        i--;
-        i |= (i >> 1);
-        i |= (i >> 2);
-        i |= (i >> 4);
-        i |= (i >> 8);
-        i |= (i >> 16);
-        return i - ((unsigned)i >> 1);
-#endif
+    void update(int v, int from, int to, int l, int r, const Tag &tag) {
+        if (l <= from && to <= r) { // node is inside query segment
+            change(v, tag, to - from + 1);
+            return;
+        }
+
+        int mid = (from + to) / 2;
+        propagate(v, from, mid, to);
+
+        if (l <= mid) {
+            update(2 * v, from, mid, l, r, tag);
+        }
+        if (r > mid) {
+            update(2 * v + 1, mid + 1, to, l, r, tag);
+        }
+
+        mValue[v] = Monoid::combine(mValue[2 * v], mValue[2 * v + 1]);
+    }
+
+    void set(int v, int from, int to, int i, const Value &value) {
+        if (from == to) {
+            mValue[v] = value;
+            return;
+        }
+
+        int mid = (from + to) / 2;
+        propagate(v, from, mid, to);
+
+        if (i <= mid) {
+            set(2 * v, from, mid, i, value);
+        } else {
+            set(2 * v + 1, mid + 1, to, i, value);
+        }
+
+        mValue[v] = Monoid::combine(mValue[2 * v], mValue[2 * v + 1]);
     }
 
-    inline bool contains(int outerFrom, int outerTo, int innerFrom, int innerTo) {
-        return innerFrom >= outerFrom && innerTo <= outerTo;
+    // pending tags are applied to the partial result instead of being pushed
+    // down, so queries never write and may run concurrently
+    Value query(int v, int from, int to, int l, int r) const {
+        if (l <= from && to <= r) { // node segment is inside of queried segment
+            return mValue[v];
+        }
+
+        int mid = (from + to) / 2;
+        Value result;
+        if (r <= mid) {
+            result = query(2 * v, from, mid, l, r);
+        } else if (l > mid) {
+            result = query(2 * v + 1, mid + 1, to, l, r);
+        } else {
+            result = Monoid::combine(query(2 * v, from, mid, l, r), query(2 * v + 1, mid + 1, to, l, r));
+        }
+
+        if (mHasPending[v]) {
+            int size = min(r, to) - max(l, from) + 1;
+            result = Action::template apply<Monoid>(mPending[v], result, size);
+        }
+        return result;
     }
 
-    inline bool intersects(int from1, int to1, int from2, int to2) {
-        return (from1 <= from2 && to1 >= from2) || (from1 >= from2 && from1 <= to2);
+    // applies updates mBatch[depth][begin, end) in their order. A run of updates
+    // covering the node is composed into its tag, a run of partial ones goes
+    // down to the children, so every update reaches only nodes it would reach
+    // alone: O(log n) each instead of following other updates down
+    void update(int v, int from, int to, int depth, int begin, int end, const vector<Update> &updates) {
+        int i = begin;
+        while (i < end) {
+            while (i < end && covers(updates[mBatch[depth][i]], from, to)) {
+                change(v, updates[mBatch[depth][i]].tag, to - from + 1);
+                i++;
+            }
+
+            int partial = i;
+            while (i < end && !covers(updates[mBatch[depth][i]], from, to)) {
+                i++;
+            }
+            if (partial < i) {
+                pushDown(v, from, to, depth, partial, i, updates);
+            }
+        }
     }
 
-    inline void change(Node &n, int value) {
-        /**
-          update target values according to your logic here!
-          */
-        n.pending = value;
-        n.min = value;
-        mArray[n.from] = value;
+    static inline bool covers(const Update &u, int from, int to) {
+        return u.from <= from && to <= u.to;
     }
 
-    void propagate(int v) {
-        Node &n = mHeap[v];
+    // splits updates mBatch[depth][begin, end), none of which covers node v, between its children
+    void pushDown(int v, int from, int to, int depth, int begin, int end, const vector<Update> &updates) {
+        int mid = (from + to) / 2;
+        propagate(v, from, mid, to);
+
+        if ((int)mBatch.size() <= depth + 1) {
+            mBatch.resize(depth + 2);
+        }
+
+        for (int child = 0; child < 2; child++) {
+            int childFrom = child ? mid + 1 : from;
+            int childTo = child ? to : mid;
+
+            vector<int> &next = mBatch[depth + 1];
+            const vector<int> &current = mBatch[depth]; // resize above may move it
+            next.clear();
+            for (int i = begin; i < end; i++) {
+                const Update &u = updates[current[i]];
+                if (u.from <= childTo && u.to >= childFrom) {
+                    next.push_back(current[i]);
+                }
+            }
 
-        if (n.pending) {
-            if (n.size() != 1) {
-                change(mHeap[2 * v], n.pending);
-                change(mHeap[2 * v + 1], n.pending);
+            if (!next.empty()) {
+                update(2 * v + child, childFrom, childTo, depth + 1, 0, next.size(), updates);
             }
-            n.pending = 0;
         }
+
+        mValue[v] = Monoid::combine(mValue[2 * v], mValue[2 * v + 1]);
+    }
+
+    void build(const vector<Value> &values, int v, int from, int to) {
+        if (from == to) { // leaf initialization
+            mValue[v] = values[from];
+            return;
+        }
+
+        int mid = (from + to) / 2;
+        build(values, 2 * v, from, mid);
+        build(values, 2 * v + 1, mid + 1, to);
+
+        mValue[v] = Monoid::combine(mValue[2 * v], mValue[2 * v + 1]);
     }
 
-    void update(int v, int from, int to, int value) {
-        Node &n = mHeap[v];
+public:
 
-        if (contains(from, to, n.from, n.to)) { // node is inside query segment
-            change(n, value);
+    SegmentTree(const vector<Value> &values)
+        : mValue(4 * max<size_t>(values.size(), 1), Monoid::identity()),
+          mPending(4 * max<size_t>(values.size(), 1)),
+          mHasPending(4 * max<size_t>(values.size(), 1)),
+          mSize(values.size()) {
+        if (mSize) {
+            build(values, 1, 0, mSize - 1);
         }
+    }
 
-        if (n.size() == 1) {
+    // aggregate on [from, to]
+    Value query(int from, int to) const {
+        assert(from >= 0 && from <= to && to < mSize);
+        return query(1, 0, mSize - 1, from, to);
+    }
+
+    Value RMQ(int from, int to) const {
+        return query(from, to);
+    }
+
+    // answers ranges [first, second] by single query() calls split into equal
+    // chunks over up to threads threads. Only a threading wrapper: every range
+    // still walks from the root (a shared-descent batch traversal measured 2x
+    // slower on random ranges). Tree must not be modified until the call returns
+    void queryParallel(const vector<pair<int, int>> &ranges, vector<Value> &out, int threads = 1) const {
+        out.resize(ranges.size());
+
+        int count = ranges.size();
+        threads = max(1, min(threads, count));
+
+        auto work = [&](int from, int to) {
+            for (int i = from; i < to; i++) {
+                out[i] = query(ranges[i].first, ranges[i].second);
+            }
+        };
+
+        vector<thread> workers;
+        for (int t = 1; t < threads; t++) {
+            workers.push_back(thread(work, (long long)count * t / threads, (long long)count * (t + 1) / threads));
+        }
+        work(0, count / threads);
+
+        for (thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    int size() const {
+        return mSize;
+    }
+
+    // applies tag to every element of [from, to]
+    void update(int from, int to, const Tag &tag) {
+        assert(from >= 0 && from <= to && to < mSize);
+        update(1, 0, mSize - 1, from, to, tag);
+    }
+
+    // same as calling update() for every element of updates in order,
+    // but in one top-down pass, updates are split between children by position
+    void update(const vector<Update> &updates) {
+        if (updates.empty()) {
             return;
         }
 
-        if (intersects(from, to, n.from, n.to)) {
-            propagate(v);
+        mBatch.resize(max<size_t>(mBatch.size(), 1));
+        mBatch[0].resize(updates.size());
+        for (int i = 0; i < (int)updates.size(); i++) {
+            assert(updates[i].from >= 0 && updates[i].from <= updates[i].to && updates[i].to < mSize);
+            mBatch[0][i] = i;
+        }
+
+        update(1, 0, mSize - 1, 0, 0, updates.size(), updates);
+    }
+
+    void set(int i, const Value &value) {
+        assert(i >= 0 && i < mSize);
+        set(1, 0, mSize - 1, i, value);
+    }
+};
+
+
+// Non-recursive min tree for point updates and range minimum queries.
+// Power of two layout: leaves are mTree[mLeaves..2 * mLeaves), node v has
+// children 2v and 2v + 1. Node bounds are derived from the index, so every
+// node stores only its minimum (4 bytes instead of 16).
+class BottomUpSegmentTree {
+    vector<int> mTree;
+    int mLeaves;
+    int mSize;
+
+public:
+    BottomUpSegmentTree(const vector<int> &values) : mSize(values.size()) {
+        mLeaves = 1;
+        while (mLeaves < mSize) {
+            mLeaves <<= 1;
+        }
 
-            update(2 * v, from, to, value);
-            update(2 * v + 1, from, to, value);
+        mTree.assign(2 * mLeaves, numeric_limits<int>::max());
+        copy(values.begin(), values.end(), mTree.begin() + mLeaves);
 
-            n.min = min(mHeap[2 * v].min, mHeap[2 * v + 1].min);
+        for (int v = mLeaves - 1; v > 0; v--) {
+            mTree[v] = min(mTree[2 * v], mTree[2 * v + 1]);
         }
     }
 
-    int RMQ(int v, int from, int to) {
-        Node &n = mHeap[v];
-#if 0
-        if (n.pending) { // I will propagate down for any request. but it is nor necessary for RMQ
-            propagate(v);
+    // minimum on [from, to]
+    int RMQ(int from, int to) const {
+        assert(from >= 0 && from <= to && to < mSize);
+
+        int result = numeric_limits<int>::max();
+        for (from += mLeaves, to += mLeaves + 1; from < to; from >>= 1, to >>= 1) {
+            if (from & 1) {
+                result = min(result, mTree[from++]);
+            }
+            if (to & 1) {
+                result = min(result, mTree[--to]);
+            }
         }
-#else
-        if (n.pending && contains(n.from, n.to, from, to)) {
-            return n.pending;
+
+        return result;
+    }
+
+    int size() const {
+        return mSize;
+    }
+
+    int get(int i) const {
+        return mTree[mLeaves + i];
+    }
+
+    void update(int i, int value) {
+        assert(i >= 0 && i < mSize);
+
+        int v = i + mLeaves;
+        mTree[v] = value;
+        for (v >>= 1; v > 0; v >>= 1) {
+            int m = min(mTree[2 * v], mTree[2 * v + 1]);
+            if (mTree[v] == m) { // ancestors are not affected
+                break;
+            }
+            mTree[v] = m;
+        }
+    }
+};
+
+
+// Read-mostly range minimum: array is split into blocks of BLOCK elements,
+// queries scan partial blocks with SIMD min and take full blocks from sparse
+// table over block minima in O(1). Updates rebuild only affected blocks and
+// the sparse table entries covering them.
+// Same RMQ/update/set interface as SegmentTree<MinMonoid<int>, AssignAction<int>>.
+class BlockRMQ {
+    static const int BLOCK = 32;
+
+    vector<int> mData;          // padded with int max up to whole blocks
+    vector<vector<int>> mTable; // mTable[k][j] - min of blocks j..j + 2^k - 1
+    int mSize;
+
+    static inline int log2(int x) {
+        return 31 - __builtin_clz(x);
+    }
+
+    // min of mData[from, to)
+    inline int scan(int from, int to) const {
+        const int *p = mData.data();
+        int result = numeric_limits<int>::max();
+#if defined(__AVX2__)
+        if (to - from >= 8) {
+            __m256i m = _mm256_set1_epi32(numeric_limits<int>::max());
+            for (; from + 8 <= to; from += 8) {
+                m = _mm256_min_epi32(m, _mm256_loadu_si256((const __m256i *)(p + from)));
+            }
+            __m128i h = _mm_min_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+            h = _mm_min_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+            h = _mm_min_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+            result = _mm_cvtsi128_si32(h);
+        }
+#elif defined(__SSE4_1__)
+        if (to - from >= 4) {
+            __m128i m = _mm_set1_epi32(numeric_limits<int>::max());
+            for (; from + 4 <= to; from += 4) {
+                m = _mm_min_epi32(m, _mm_loadu_si128((const __m128i *)(p + from)));
+            }
+            m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+            m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+            result = _mm_cvtsi128_si32(m);
         }
 #endif
-        if (contains(from, to, n.from, n.to)) { // Node segment is inside of queried segment
-            return mHeap[v].min;
+        for (; from < to; from++) {
+            result = min(result, p[from]);
         }
+        return result;
+    }
 
-        if (intersects(from, to, n.from, n.to)) {
-            propagate(v);
-            int leftMin = RMQ(2 * v, from, to);
-            int rightMin = RMQ(2 * v + 1, from, to);
+    inline int blocksMin(int from, int to) const {
+        int k = log2(to - from + 1);
+        return min(mTable[k][from], mTable[k][to - (1 << k) + 1]);
+    }
 
-            return min(leftMin, rightMin);
+    // recomputes minima of blocks [from, to] and table entries depending on them
+    void rebuild(int from, int to) {
+        bool changed = false;
+        for (int b = from; b <= to; b++) {
+            int m = scan(b * BLOCK, (b + 1) * BLOCK);
+            changed |= mTable[0][b] != m;
+            mTable[0][b] = m;
         }
 
-        // queried segment does not intersect Node segment
-        return numeric_limits<int>::max();
+        for (int k = 1; k < (int)mTable.size() && changed; k++) {
+            changed = false;
+            int half = 1 << (k - 1);
+            int first = max(0, from - (1 << k) + 1);
+            int last = min(to, (int)mTable[k].size() - 1);
+            for (int j = first; j <= last; j++) {
+                int m = min(mTable[k - 1][j], mTable[k - 1][j + half]);
+                changed |= mTable[k][j] != m;
+                mTable[k][j] = m;
+            }
+        }
     }
 
-    void build(int v, int from, int size) {
-        Node &n = mHeap[v];
-        n.from = from;
-        n.to = from + size - 1;
+public:
+    BlockRMQ(const vector<int> &values) : mSize(values.size()) {
+        int blocks = max(1, (mSize + BLOCK - 1) / BLOCK);
+        mData.assign(blocks * BLOCK, numeric_limits<int>::max());
+        copy(values.begin(), values.end(), mData.begin());
 
-        if (n.size() == 1) { // leaf initialization
-            n.min = mArray[from];
-        } else { // init node with childs
-            int lSize = prevPow2(size);
-            build(2 * v, from, lSize);
-            build(2 * v + 1, from + lSize, size - lSize);
+        mTable.resize(log2(blocks) + 1);
+        mTable[0].resize(blocks);
+        for (int b = 0; b < blocks; b++) {
+            mTable[0][b] = scan(b * BLOCK, (b + 1) * BLOCK);
+        }
 
-            n.min = min(mHeap[2 * v].min, mHeap[2 * v + 1].min);
+        for (int k = 1; k < (int)mTable.size(); k++) {
+            int half = 1 << (k - 1);
+            mTable[k].resize(blocks - (1 << k) + 1);
+            for (int j = 0; j < (int)mTable[k].size(); j++) {
+                mTable[k][j] = min(mTable[k - 1][j], mTable[k - 1][j + half]);
+            }
         }
     }
 
+    // minimum on [from, to]
+    int RMQ(int from, int to) const {
+        assert(from >= 0 && from <= to && to < mSize);
+
+        int bf = from / BLOCK;
+        int bt = to / BLOCK;
+        if (bf == bt) {
+            return scan(from, to + 1);
+        }
+
+        int result = min(scan(from, (bf + 1) * BLOCK), scan(bt * BLOCK, to + 1));
+        if (bf + 1 < bt) {
+            result = min(result, blocksMin(bf + 1, bt - 1));
+        }
+        return result;
+    }
+
+    int size() const {
+        return mSize;
+    }
+
+    // assigns value to every element of [from, to]
+    void update(int from, int to, int value) {
+        assert(from >= 0 && from <= to && to < mSize);
+
+        fill(mData.begin() + from, mData.begin() + to + 1, value);
+        rebuild(from / BLOCK, to / BLOCK);
+    }
+
+    void set(int i, int value) {
+        update(i, i, value);
+    }
+};
+
+
+// Persistent segment tree: every point update creates a new version and
+// copies only the O(log n) nodes on the root-to-leaf path, the rest of the
+// tree is shared with the previous version. Nodes live in one contiguous
+// arena and refer to children by 32-bit indices.
+template <typename Monoid>
+class PersistentSegmentTree {
 public:
+    typedef typename Monoid::Value Value;
+
+private:
+    struct Node {
+        Value value;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    vector<Node> mNodes;
+    vector<uint32_t> mRoots;   // root of every version
+    size_t mBaseNodes = 0;     // nodes of version 0
+    int mSize;
 
-    SegmentTree(const vector<int> &values) : mHeap(values.size() * 2), mArray(values) {
-        mArray = values;
-        build(1, 0, mArray.size());
+    inline uint32_t make(const Value &value, uint32_t left, uint32_t right) {
+        assert(mNodes.size() < numeric_limits<uint32_t>::max());
+        mNodes.push_back(Node{value, left, right});
+        return mNodes.size() - 1;
     }
 
-    int RMQ(int from, int to) {
-        return RMQ(1, from, to);
+    uint32_t build(const vector<Value> &values, int from, int to) {
+        if (from == to) {
+            return make(values[from], 0, 0);
+        }
+
+        int mid = (from + to) / 2;
+        uint32_t left = build(values, from, mid);
+        uint32_t right = build(values, mid + 1, to);
+        return make(Monoid::combine(mNodes[left].value, mNodes[right].value), left, right);
     }
 
-    int size() {
-        return mArray.size();
+    uint32_t set(uint32_t v, int from, int to, int i, const Value &value) {
+        if (from == to) {
+            return make(value, 0, 0);
+        }
+
+        int mid = (from + to) / 2;
+        uint32_t left = mNodes[v].left;
+        uint32_t right = mNodes[v].right;
+        if (i <= mid) {
+            left = set(left, from, mid, i, value);
+        } else {
+            right = set(right, mid + 1, to, i, value);
+        }
+        return make(Monoid::combine(mNodes[left].value, mNodes[right].value), left, right);
     }
 
-    void update(int from, int to, int value) {
-        update(1, from, to, value);
+    Value query(uint32_t v, int from, int to, int l, int r) const {
+        if (l <= from && to <= r) {
+            return mNodes[v].value;
+        }
+
+        int mid = (from + to) / 2;
+        if (r <= mid) {
+            return query(mNodes[v].left, from, mid, l, r);
+        }
+        if (l > mid) {
+            return query(mNodes[v].right, mid + 1, to, l, r);
+        }
+        return Monoid::combine(query(mNodes[v].left, from, mid, l, r), query(mNodes[v].right, mid + 1, to, l, r));
+    }
+
+public:
+    // creates version 0, reserves arena for expectedUpdates point updates.
+    // Empty values give a single identity root, queries then return identity
+    PersistentSegmentTree(const vector<Value> &values, size_t expectedUpdates = 0) : mSize(values.size()) {
+        if (!mSize) {
+            mRoots.push_back(make(Monoid::identity(), 0, 0));
+            mBaseNodes = mNodes.size();
+            return;
+        }
+
+        int depth = 1;
+        while ((1 << (depth - 1)) < mSize) {
+            depth++;
+        }
+        mNodes.reserve(2 * mSize + expectedUpdates * depth);
+        mRoots.reserve(expectedUpdates + 1);
+
+        mRoots.push_back(build(values, 0, mSize - 1));
+        mBaseNodes = mNodes.size();
+    }
+
+    int size() const {
+        return mSize;
+    }
+
+    int versions() const {
+        return mRoots.size();
+    }
+
+    size_t nodes() const {
+        return mNodes.size();
+    }
+
+    // aggregate on [from, to] as of given version
+    Value query(int version, int from, int to) const {
+        assert(version >= 0 && version < versions());
+        if (!mSize) {
+            return Monoid::identity();
+        }
+        assert(from >= 0 && from <= to && to < mSize);
+        return query(mRoots[version], 0, mSize - 1, from, to);
+    }
+
+    Value RMQ(int version, int from, int to) const {
+        return query(version, from, to);
+    }
+
+    // creates new version equal to given one with element i set to value, returns its number
+    int set(int version, int i, const Value &value) {
+        assert(version >= 0 && version < versions());
+        assert(i >= 0 && i < mSize);
+        mRoots.push_back(set(mRoots[version], 0, mSize - 1, i, value));
+        return mRoots.size() - 1;
+    }
+
+    // drops every version except 0, arena memory is kept for reuse
+    void reset() {
+        mNodes.resize(mBaseNodes);
+        mRoots.resize(1);
+    }
+};
+
+
+class SegmentTreeTester {
+
+    static void t1() {
+        mt19937 rnd(1);
+
+        for (int n = 1; n < 70; n++) {
+            vector<int> values(n);
+            for (int &v : values) {
+                v = rnd() % 100;
+            }
+
+            BottomUpSegmentTree t(values);
+            for (int k = 0; k < 300; k++) {
+                if (rnd() % 2) {
+                    int i = rnd() % n;
+                    values[i] = rnd() % 100;
+                    t.update(i, values[i]);
+                } else {
+                    int from = rnd() % n;
+                    int to = from + rnd() % (n - from);
+                    assert(t.RMQ(from, to) == *min_element(values.begin() + from, values.begin() + to + 1));
+                }
+            }
+        }
+
+        cout << "t1 passed" << endl;
+    }
+
+    // random range updates and queries against brute-force array
+    template <typename Monoid, typename Action, typename RandomTag>
+    static void differential(RandomTag randomTag, int seed) {
+        typedef typename Monoid::Value Value;
+        mt19937 rnd(seed);
+
+        for (int n = 1; n < 70; n++) {
+            vector<Value> values(n);
+            for (Value &v : values) {
+                v = rnd() % 100;
+            }
+
+            SegmentTree<Monoid, Action> t(values);
+            for (int k = 0; k < 300; k++) {
+                int from = rnd() % n;
+                int to = from + rnd() % (n - from);
+
+                if (k % 3 == 0) {
+                    auto tag = randomTag(rnd);
+                    t.update(from, to, tag);
+                    for (int i = from; i <= to; i++) {
+                        values[i] = Action::template apply<Monoid>(tag, values[i], 1);
+                    }
+                } else if (k % 3 == 1) {
+                    values[from] = rnd() % 100;
+                    t.set(from, values[from]);
+                } else {
+                    Value expected = Monoid::identity();
+                    for (int i = from; i <= to; i++) {
+                        expected = Monoid::combine(expected, values[i]);
+                    }
+                    assert(t.query(from, to) == expected);
+                }
+            }
+        }
+    }
+
+    static void t2() {
+        auto add = [](mt19937 &rnd) { return (long long)(rnd() % 21) - 10; };
+        auto affine = [](mt19937 &rnd) { return AffineAction<long long>::Tag{(long long)(rnd() % 2), (long long)(rnd() % 21) - 10}; };
+
+        differential<SumMonoid<long long>, AddAction<long long>>(add, 1);
+        differential<MinMonoid<long long>, AddAction<long long>>(add, 2);
+        differential<MaxMonoid<long long>, AddAction<long long>>(add, 3);
+        differential<SumMonoid<long long>, AffineAction<long long>>(affine, 4);
+        differential<MinMonoid<long long>, AffineAction<long long>>(affine, 5);
+        differential<MaxMonoid<long long>, AffineAction<long long>>(affine, 6);
+
+        cout << "t2 passed" << endl;
+    }
+
+    // assignment of 0 must not be mistaken for "no pending update"
+    static void t3() {
+        auto assign = [](mt19937 &rnd) { return (long long)(rnd() % 3); };
+
+        differential<SumMonoid<long long>, AssignAction<long long>>(assign, 7);
+        differential<MinMonoid<long long>, AssignAction<long long>>(assign, 8);
+        differential<MaxMonoid<long long>, AssignAction<long long>>(assign, 9);
+
+        SegmentTree<MinMonoid<int>, AssignAction<int>> t(vector<int>({5, 3, 8, 1, 9, 4}));
+        t.update(0, 5, 0);
+        assert(t.RMQ(0, 5) == 0);
+        assert(t.RMQ(2, 3) == 0);
+        t.update(1, 4, 7);
+        assert(t.RMQ(0, 5) == 0);
+        assert(t.RMQ(1, 4) == 7);
+        assert(t.RMQ(2, 2) == 7);
+        t.update(3, 3, 2);
+        assert(t.RMQ(1, 5) == 0);
+        assert(t.RMQ(1, 4) == 2);
+
+        cout << "t3 passed" << endl;
+    }
+
+    static void t4() {
+        mt19937 rnd(10);
+
+        for (int n = 1; n < 300; n += 7) {
+            vector<int> values(n);
+            for (int &v : values) {
+                v = rnd() % 1000 - 500;
+            }
+
+            BlockRMQ t(values);
+            for (int k = 0; k < 300; k++) {
+                int from = rnd() % n;
+                int to = from + rnd() % (n - from);
+                if (k % 4 == 0) {
+                    int value = rnd() % 1000 - 500;
+                    t.update(from, to, value);
+                    fill(values.begin() + from, values.begin() + to + 1, value);
+                } else if (k % 4 == 1) {
+                    values[from] = rnd() % 1000 - 500;
+                    t.set(from, values[from]);
+                } else {
+                    assert(t.RMQ(from, to) == *min_element(values.begin() + from, values.begin() + to + 1));
+                }
+            }
+        }
+
+        cout << "t4 passed" << endl;
+    }
+
+    // batch update and parallel queries give the same results as single calls
+    template <typename Monoid, typename Action, typename RandomTag>
+    static void batch(RandomTag randomTag, int seed) {
+        typedef SegmentTree<Monoid, Action> Tree;
+        typedef typename Monoid::Value Value;
+        mt19937 rnd(seed);
+
+        for (int n = 1; n < 70; n++) {
+            vector<Value> values(n);
+            for (Value &v : values) {
+                v = rnd() % 100;
+            }
+
+            Tree single(values);
+            Tree batched(values);
+            for (int k = 0; k < 20; k++) {
+                vector<typename Tree::Update> updates(rnd() % (k % 5 ? 10 : 300));
+                for (auto &u : updates) {
+                    u.from = rnd() % n;
+                    u.to = u.from + rnd() % (n - u.from);
+                    u.tag = randomTag(rnd);
+                    single.update(u.from, u.to, u.tag);
+                }
+                batched.update(updates);
+
+                vector<pair<int, int>> ranges(rnd() % 20);
+                for (auto &r : ranges) {
+                    r.first = rnd() % n;
+                    r.second = r.first + rnd() % (n - r.first);
+                }
+
+                vector<Value> out1;
+                vector<Value> out3;
+                batched.queryParallel(ranges, out1, 1);
+                batched.queryParallel(ranges, out3, 3);
+                for (int i = 0; i < (int)ranges.size(); i++) {
+                    assert(out1[i] == single.query(ranges[i].first, ranges[i].second));
+                    assert(out3[i] == out1[i]);
+                }
+            }
+        }
+    }
+
+    static void t5() {
+        auto add = [](mt19937 &rnd) { return (long long)(rnd() % 21) - 10; };
+        auto assign = [](mt19937 &rnd) { return (long long)(rnd() % 3); };
+        auto affine = [](mt19937 &rnd) { return AffineAction<long long>::Tag{(long long)(rnd() % 2), (long long)(rnd() % 21) - 10}; };
+
+        batch<SumMonoid<long long>, AddAction<long long>>(add, 11);
+        batch<MinMonoid<long long>, AssignAction<long long>>(assign, 12);
+        batch<SumMonoid<long long>, AssignAction<long long>>(assign, 13);
+        batch<MaxMonoid<long long>, AffineAction<long long>>(affine, 14);
+
+        cout << "t5 passed" << endl;
+    }
+
+    static void t6() {
+        mt19937 rnd(15);
+
+        for (int n = 1; n < 50; n++) {
+            vector<vector<int>> history(1, vector<int>(n));
+            for (int &v : history[0]) {
+                v = rnd() % 100;
+            }
+
+            PersistentSegmentTree<MinMonoid<int>> t(history[0]);
+            for (int round = 0; round < 2; round++) {
+                for (int k = 0; k < 100; k++) {
+                    int version = rnd() % history.size();
+                    int i = rnd() % n;
+                    int value = rnd() % 100;
+
+                    history.push_back(history[version]);
+                    history.back()[i] = value;
+                    assert(t.set(version, i, value) == (int)history.size() - 1);
+                }
+
+                for (int k = 0; k < 300; k++) {
+                    int version = rnd() % history.size();
+                    int from = rnd() % n;
+                    int to = from + rnd() % (n - from);
+                    const vector<int> &values = history[version];
+                    assert(t.RMQ(version, from, to) == *min_element(values.begin() + from, values.begin() + to + 1));
+                }
+
+                t.reset();
+                history.resize(1);
+                assert(t.versions() == 1);
+            }
+        }
+
+        PersistentSegmentTree<MinMonoid<int>> empty((vector<int>()));
+        assert(empty.size() == 0 && empty.versions() == 1);
+        assert(empty.RMQ(0, 0, 0) == MinMonoid<int>::identity());
+
+        cout << "t6 passed" << endl;
+    }
+
+public:
+    // point update / range minimum workload
+    static void benchmark(int n = 10000000, int operations = 10000000) {
+        mt19937 rnd(42);
+        vector<int> values(n);
+        for (int &v : values) {
+            v = rnd() % 1000000000 + 1;
+        }
+
+        vector<int> ops(3 * operations);
+        for (int &v : ops) {
+            v = rnd() % 1000000000 + 1;
+        }
+
+        long long checksum1 = 0;
+        long long checksum2 = 0;
+
+        {
+            SegmentTree<MinMonoid<int>, AddAction<int>> t(values);
+            auto start = chrono::steady_clock::now();
+            for (int k = 0; k < operations; k++) {
+                int a = ops[3 * k] % n;
+                int b = ops[3 * k + 1] % n;
+                if (k % 2) {
+                    t.set(a, ops[3 * k + 2]);
+                } else {
+                    checksum1 += t.RMQ(min(a, b), max(a, b));
+                }
+            }
+            auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+            cout << "SegmentTree:\t\t" << elapsed.count() << " ms" << endl;
+        }
+
+        {
+            BottomUpSegmentTree t(values);
+            auto start = chrono::steady_clock::now();
+            for (int k = 0; k < operations; k++) {
+                int a = ops[3 * k] % n;
+                int b = ops[3 * k + 1] % n;
+                if (k % 2) {
+                    t.update(a, ops[3 * k + 2]);
+                } else {
+                    checksum2 += t.RMQ(min(a, b), max(a, b));
+                }
+            }
+            auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+            cout << "BottomUpSegmentTree:\t" << elapsed.count() << " ms" << endl;
+        }
+
+        assert(checksum1 == checksum2);
     }
 
-    void print() {
-        for (int i = 1; i < (int)mHeap.size(); i++) {
-            Node &n = mHeap[i];
-            cout << i << " :\t[" << n.from << "-" << n.to << "] \tmin: " << n.min << "; \tpending: " << n.pending << endl;
-            if (n.size() == 1) {
-                cout << "    leaf value: " << mArray[mHeap[i].from] << endl;
+    // range assign / range minimum workload
+    static void benchmarkLazy(int n = 10000000, int operations = 10000000) {
+        mt19937 rnd(42);
+        vector<int> values(n);
+        for (int &v : values) {
+            v = rnd() % 1000000000;
+        }
+
+        long long checksum = 0;
+        SegmentTree<MinMonoid<int>, AssignAction<int>> t(values);
+
+        auto start = chrono::steady_clock::now();
+        for (int k = 0; k < operations; k++) {
+            int a = rnd() % n;
+            int b = rnd() % n;
+            if (a > b) {
+                swap(a, b);
+            }
+
+            if (k % 2) {
+                t.update(a, b, rnd() % 1000000000);
+            } else {
+                checksum += t.RMQ(a, b);
             }
         }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        cout << "SegmentTree<Min, Assign>:\t" << elapsed.count() << " ms (checksum " << checksum << ")" << endl;
     }
 
+    // read-mostly workload: one point update per updateEvery queries
+    static void benchmarkReadMostly(int n = 10000000, int operations = 10000000, int updateEvery = 1000) {
+        mt19937 rnd(42);
+        vector<int> values(n);
+        for (int &v : values) {
+            v = rnd() % 1000000000;
+        }
+
+        vector<int> ops(3 * operations);
+        for (int &v : ops) {
+            v = rnd() % 1000000000;
+        }
+
+        long long checksum1 = 0;
+        long long checksum2 = 0;
 
+        {
+            SegmentTree<MinMonoid<int>, AssignAction<int>> t(values);
+            auto start = chrono::steady_clock::now();
+            for (int k = 0; k < operations; k++) {
+                int a = ops[3 * k] % n;
+                int b = ops[3 * k + 1] % n;
+                if (k % updateEvery == 0) {
+                    t.set(a, ops[3 * k + 2]);
+                } else {
+                    checksum1 += t.RMQ(min(a, b), max(a, b));
+                }
+            }
+            auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+            cout << "SegmentTree:\t" << elapsed.count() << " ms" << endl;
+        }
+
+        {
+            BlockRMQ t(values);
+            auto start = chrono::steady_clock::now();
+            for (int k = 0; k < operations; k++) {
+                int a = ops[3 * k] % n;
+                int b = ops[3 * k + 1] % n;
+                if (k % updateEvery == 0) {
+                    t.set(a, ops[3 * k + 2]);
+                } else {
+                    checksum2 += t.RMQ(min(a, b), max(a, b));
+                }
+            }
+            auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+            cout << "BlockRMQ:\t" << elapsed.count() << " ms" << endl;
+        }
+
+        assert(checksum1 == checksum2);
+    }
+
+    // range minimum queries against static tree, single calls and queryParallel()
+    static void benchmarkBatch(int n = 10000000, int queries = 10000000) {
+        mt19937 rnd(42);
+        vector<int> values(n);
+        for (int &v : values) {
+            v = rnd() % 1000000000;
+        }
+
+        vector<pair<int, int>> ranges(queries);
+        for (auto &r : ranges) {
+            int a = rnd() % n;
+            int b = rnd() % n;
+            r = make_pair(min(a, b), max(a, b));
+        }
+
+        SegmentTree<MinMonoid<int>, AssignAction<int>> t(values);
+
+        long long checksum = 0;
+        auto start = chrono::steady_clock::now();
+        for (auto &r : ranges) {
+            checksum += t.RMQ(r.first, r.second);
+        }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        cout << "single:\t\t" << elapsed.count() << " ms" << endl;
+
+        int maxThreads = max(1u, thread::hardware_concurrency());
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            vector<int> out;
+            start = chrono::steady_clock::now();
+            t.queryParallel(ranges, out, threads);
+            elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+            long long batchChecksum = 0;
+            for (int v : out) {
+                batchChecksum += v;
+            }
+            assert(batchChecksum == checksum);
+
+            cout << "parallel, " << threads << " threads:\t" << elapsed.count() << " ms" << endl;
+        }
+    }
+
+    // batch of random range updates against a loop of single updates
+    static void benchmarkBatchUpdate(int n = 1000000, int count = 100000) {
+        typedef SegmentTree<SumMonoid<long long>, AddAction<long long>> Tree;
+        mt19937 rnd(42);
+        vector<long long> values(n);
+        for (long long &v : values) {
+            v = rnd() % 1000;
+        }
+
+        vector<Tree::Update> updates(count);
+        for (auto &u : updates) {
+            int a = rnd() % n;
+            int b = rnd() % n;
+            u = Tree::Update{min(a, b), max(a, b), (long long)(rnd() % 21) - 10};
+        }
+
+        Tree single(values);
+        auto start = chrono::steady_clock::now();
+        for (auto &u : updates) {
+            single.update(u.from, u.to, u.tag);
+        }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        cout << count << " single updates:\t" << elapsed.count() << " ms" << endl;
+
+        Tree batched(values);
+        start = chrono::steady_clock::now();
+        batched.update(updates);
+        elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        cout << count << " updates in a batch:\t" << elapsed.count() << " ms" << endl;
+
+        for (int k = 0; k < 1000; k++) {
+            int a = rnd() % n;
+            int b = rnd() % n;
+            assert(single.query(min(a, b), max(a, b)) == batched.query(min(a, b), max(a, b)));
+        }
+    }
+
+    // versions updates of n element array, each on top of the previous one
+    static void benchmarkPersistent(int n = 1000000, int versions = 1000000) {
+        mt19937 rnd(42);
+        vector<int> values(n);
+        for (int &v : values) {
+            v = rnd() % 1000000000;
+        }
+
+        auto start = chrono::steady_clock::now();
+        PersistentSegmentTree<MinMonoid<int>> t(values, versions);
+        for (int k = 0; k < versions; k++) {
+            t.set(k, rnd() % n, rnd() % 1000000000);
+        }
+
+        long long checksum = 0;
+        for (int k = 0; k < versions; k++) {
+            int a = rnd() % n;
+            int b = rnd() % n;
+            checksum += t.RMQ(rnd() % t.versions(), min(a, b), max(a, b));
+        }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+        cout << "PersistentSegmentTree: " << t.versions() << " versions, " << t.nodes() << " nodes, "
+             << elapsed.count() << " ms (checksum " << checksum << ")" << endl;
+    }
+
+    static void main() {
+        t1();
+        t2();
+        t3();
+        t4();
+        t5();
+        t6();
+
+        cout << "cool!" << endl;
+    }
 };
@@ -2,8 +2,23 @@
 #include <vector>
 #include <cstdlib>
 #include <ctime>
+#include <cstdint>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <cassert>
+#include <cstdio>
 
 // 3-way string quicksort a[lo..hi] starting at dth character
+// characters are compared as unsigned bytes, same order as strcmp
 void sort(vector<const char *> &a, int lo, int hi, int d) {
 
     // cutoff to insertion sort for small subarrays ( < 15 )
@@ -19,10 +34,10 @@ void sort(vector<const char *> &a, int lo, int hi, int d) {
     // run 3-way sort
     int lt = lo;
     int gt = hi;
-    int v = a[lo][d];
+    int v = (unsigned char)a[lo][d];
     int i = lo + 1;
     while (i <= gt) {
-        int t = a[i][d];
+        int t = (unsigned char)a[i][d];
         if (t < v) {
             swap(a[lt++], a[i++]);
         } else if (t > v) {
@@ -34,7 +49,7 @@ void sort(vector<const char *> &a, int lo, int hi, int d) {
 
     // a[lo..lt-1] < v = a[lt..gt] < a[gt+1..hi].
     sort(a, lo, lt-1, d);
-    if (v >= 0) {
+    if (v != 0) {
         sort(a, lt, gt, d+1);
     }
 
@@ -53,3 +68,1210 @@ void sort(vector<const char *> &a) {
     // sort
     sort(a, 0, (int)a.size() - 1, 0);
 }
+
+
+// MSD radix sort with in-place American flag distribution.
+// Digit of every key is read once per level and cached in digits[], so the
+// permutation pass does not dereference the strings again. Large buckets
+// are distributed by 2-byte digits, small ones go to 3-way quicksort.
+const int RADIX_CUTOFF = 64;            // smaller buckets use multikey quicksort
+const int RADIX_TWO_BYTES = 1 << 16;    // larger buckets use 2-byte digits
+
+// one American flag pass: distributes a[lo, hi) by digit of digitBytes bytes at
+// position d, returns end of every bucket, digits[lo, hi) is scratch space
+vector<int> radixDistribute(vector<const char *> &a, vector<uint16_t> &digits, int lo, int hi, int d, int digitBytes) {
+    int buckets = 1 << (8 * digitBytes);
+
+    // count digits, digit 0 - key ended at d, for 2-byte digits low byte 0 - key ended at d + 1
+    vector<int> next(buckets + 1);
+    for (int i = lo; i < hi; i++) {
+        const unsigned char *s = (const unsigned char *)a[i] + d;
+        int digit = s[0];
+        if (digitBytes == 2 && digit) {
+            digit = (digit << 8) | s[1];
+        }
+        digits[i] = digit;
+        next[digit + 1]++;
+    }
+
+    // next[b] - first unplaced position of bucket b, next[b + 1] - end of it when done
+    next[0] = lo;
+    for (int b = 0; b < buckets; b++) {
+        next[b + 1] += next[b];
+    }
+    vector<int> end(next.begin() + 1, next.end());
+
+    // in-place permutation, every swap puts one key into its bucket
+    for (int b = 0; b < buckets; b++) {
+        while (next[b] < end[b]) {
+            int i = next[b];
+            int digit = digits[i];
+            if (digit == b) {
+                next[b]++;
+            } else {
+                int j = next[digit]++;
+                swap(a[i], a[j]);
+                swap(digits[i], digits[j]);
+            }
+        }
+    }
+
+    return end;
+}
+
+// true if bucket b of radixDistribute holds keys that already ended
+inline bool radixBucketEnded(int b, int digitBytes) {
+    return digitBytes == 1 ? b == 0 : (b & 0xff) == 0;
+}
+
+// sorts a[lo, hi) starting at dth character, digits[lo, hi) is scratch space
+void msdRadixSort(vector<const char *> &a, vector<uint16_t> &digits, int lo, int hi, int d) {
+    if (hi - lo < RADIX_CUTOFF) {
+        sort(a, lo, hi - 1, d);
+        return;
+    }
+
+    int digitBytes = hi - lo >= RADIX_TWO_BYTES ? 2 : 1;
+    vector<int> end = radixDistribute(a, digits, lo, hi, d, digitBytes);
+
+    int from = lo;
+    for (int b = 0; b < (int)end.size(); b++) {
+        int to = end[b];
+        if (to - from > 1 && !radixBucketEnded(b, digitBytes)) {
+            msdRadixSort(a, digits, from, to, d + digitBytes);
+        }
+        from = to;
+    }
+}
+
+void msdRadixSort(vector<const char *> &a) {
+    vector<uint16_t> digits(a.size());
+    msdRadixSort(a, digits, 0, a.size(), 0);
+}
+
+
+// Parallel string sort. First level is a sample sort: keys are classified in
+// parallel by sorted sample splitters into buckets "< s1", "== s1",
+// "(s1, s2)", "== s2", ... and scattered into place. Buckets become tasks on
+// per-thread deques. Large tasks are split by one radix pass into subtasks
+// pushed to the owner's deque, idle threads steal the oldest (largest) tasks
+// of other threads, so skewed inputs still keep every thread busy.
+const int PARALLEL_CUTOFF = 1 << 15;        // smaller tasks are sorted sequentially
+const int PARALLEL_OVERSAMPLING = 16;       // sample keys per bucket
+const int PARALLEL_BUCKETS_PER_THREAD = 8;
+
+class ParallelStringSorter {
+    struct Task {
+        int lo;
+        int hi;
+        int d;
+    };
+
+    struct Queue {
+        mutex lock;
+        deque<Task> tasks;
+    };
+
+    vector<const char *> &mA;
+    vector<uint16_t> mDigits;
+    vector<Queue> mQueues;
+    atomic<int> mPending; // pushed but not finished tasks
+    int mThreads;
+
+    void push(int thread, const Task &task) {
+        mPending++;
+        lock_guard<mutex> guard(mQueues[thread].lock);
+        mQueues[thread].tasks.push_back(task);
+    }
+
+    bool pop(int thread, Task &task) {
+        lock_guard<mutex> guard(mQueues[thread].lock);
+        if (mQueues[thread].tasks.empty()) {
+            return false;
+        }
+        task = mQueues[thread].tasks.back();
+        mQueues[thread].tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int thread, Task &task) {
+        for (int i = 1; i < mThreads; i++) {
+            Queue &victim = mQueues[(thread + i) % mThreads];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(int thread, const Task &task) {
+        if (task.hi - task.lo < PARALLEL_CUTOFF) {
+            msdRadixSort(mA, mDigits, task.lo, task.hi, task.d);
+        } else {
+            vector<int> end = radixDistribute(mA, mDigits, task.lo, task.hi, task.d, 1);
+            int from = task.lo;
+            for (int b = 0; b < (int)end.size(); b++) {
+                if (end[b] - from > 1 && !radixBucketEnded(b, 1)) {
+                    push(thread, Task{from, end[b], task.d + 1});
+                }
+                from = end[b];
+            }
+        }
+        mPending--; // after subtasks are pushed, so counter can't drop to 0 early
+    }
+
+    void work(int thread) {
+        Task task;
+        while (mPending > 0) {
+            if (pop(thread, task) || steal(thread, task)) {
+                run(thread, task);
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+
+    template <typename Function>
+    void parallel(Function f) {
+        vector<thread> workers;
+        for (int t = 1; t < mThreads; t++) {
+            workers.push_back(thread(f, t));
+        }
+        f(0);
+        for (thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    static int lcp(const char *s1, const char *s2) {
+        int d = 0;
+        while (s1[d] && s1[d] == s2[d]) {
+            d++;
+        }
+        return d;
+    }
+
+    void sampleSort() {
+        int n = mA.size();
+        auto less = [](const char *s1, const char *s2) { return strcmp(s1, s2) < 0; };
+
+        mt19937 rnd(n);
+        int buckets = mThreads * PARALLEL_BUCKETS_PER_THREAD;
+        vector<const char *> sample(buckets * PARALLEL_OVERSAMPLING);
+        for (const char *&key : sample) {
+            key = mA[rnd() % n];
+        }
+        std::sort(sample.begin(), sample.end(), less);
+
+        vector<const char *> splitters;
+        for (int i = 1; i < buckets; i++) {
+            const char *key = sample[i * PARALLEL_OVERSAMPLING];
+            if (splitters.empty() || strcmp(splitters.back(), key)) {
+                splitters.push_back(key);
+            }
+        }
+
+        // class 2k - keys between splitters k - 1 and k, class 2k + 1 - keys equal to splitter k
+        int classes = 2 * splitters.size() + 1;
+        vector<vector<int>> count(mThreads, vector<int>(classes + 1));
+        auto chunk = [&](int t) { return (int)((long long)n * t / mThreads); };
+
+        parallel([&](int t) {
+            for (int i = chunk(t); i < chunk(t + 1); i++) {
+                int k = lower_bound(splitters.begin(), splitters.end(), mA[i], less) - splitters.begin();
+                int c = 2 * k + (k < (int)splitters.size() && !strcmp(mA[i], splitters[k]));
+                mDigits[i] = c;
+                count[t][c + 1]++;
+            }
+        });
+
+        // count[t][c] - first output position of class c keys of thread t
+        vector<int> classEnd(classes);
+        int position = 0;
+        for (int c = 0; c < classes; c++) {
+            for (int t = 0; t < mThreads; t++) {
+                int size = count[t][c + 1];
+                count[t][c] = position;
+                position += size;
+            }
+            classEnd[c] = position;
+        }
+
+        vector<const char *> out(n);
+        parallel([&](int t) {
+            for (int i = chunk(t); i < chunk(t + 1); i++) {
+                out[count[t][mDigits[i]]++] = mA[i];
+            }
+        });
+        mA.swap(out);
+
+        // keys between two splitters share their common prefix, equal classes are done
+        int from = 0;
+        for (int c = 0; c < classes; c += 2) {
+            int k = c / 2;
+            int d = k > 0 && k < (int)splitters.size() ? lcp(splitters[k - 1], splitters[k]) : 0;
+            if (classEnd[c] - from > 1) {
+                push(k % mThreads, Task{from, classEnd[c], d});
+            }
+            if (c + 1 < classes) {
+                from = classEnd[c + 1];
+            }
+        }
+    }
+
+public:
+    ParallelStringSorter(vector<const char *> &a, int threads)
+        : mA(a), mDigits(a.size()), mQueues(max(threads, 1)), mPending(0), mThreads(max(threads, 1)) {
+    }
+
+    void sort() {
+        if (mThreads == 1 || (int)mA.size() < PARALLEL_CUTOFF) {
+            msdRadixSort(mA, mDigits, 0, mA.size(), 0);
+            return;
+        }
+
+        sampleSort();
+        parallel([this](int t) {
+            work(t);
+        });
+    }
+};
+
+void parallelSort(vector<const char *> &a, int threads) {
+    ParallelStringSorter sorter(a, threads);
+    sorter.sort();
+}
+
+
+// Sort over {key, cached prefix, length} records. Comparisons and partitioning
+// use 8 bytes of the key starting at current depth, cached big-endian in the
+// record, so they compare as one integer without touching string storage.
+// Prefix is refilled only for keys that share the whole cached prefix.
+// Keys are binary: explicit length, zero bytes are ordinary characters,
+// shorter key is less than longer key it is a prefix of.
+struct StringRecord {
+    const char *key;
+    uint64_t prefix;    // bytes [d, d + 8) of key, zero padded, big-endian
+    uint32_t length;
+};
+
+const int CACHED_INSERTION = 16;        // insertion sort for smaller ranges
+
+// bytes [d, d + 8) of key as big-endian integer
+inline uint64_t loadPrefix(const char *key, uint32_t length, uint32_t d) {
+    const unsigned char *s = (const unsigned char *)key + d;
+    uint32_t rest = length - d;
+    if (rest >= 8) {
+        uint64_t x;
+        memcpy(&x, s, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        x = __builtin_bswap64(x);
+#endif
+        return x;
+    }
+
+    uint64_t x = 0;
+    for (uint32_t i = 0; i < rest; i++) {
+        x |= (uint64_t)s[i] << (56 - 8 * i);
+    }
+    return x;
+}
+
+// compares keys sharing first d bytes
+inline int compare(const StringRecord &r1, const StringRecord &r2, uint32_t d) {
+    if (r1.prefix != r2.prefix) {
+        return r1.prefix < r2.prefix ? -1 : 1;
+    }
+
+    uint32_t common = min(r1.length, r2.length);
+    if (common > d + 8) {
+        int c = memcmp(r1.key + d + 8, r2.key + d + 8, common - d - 8);
+        if (c) {
+            return c;
+        }
+    }
+    return r1.length < r2.length ? -1 : (r1.length > r2.length);
+}
+
+// sorts a[lo, hi), all keys share first d bytes and have prefix cached at d
+void cachedSort(vector<StringRecord> &a, int lo, int hi, uint32_t d) {
+    if (hi - lo <= CACHED_INSERTION) {
+        for (int i = lo + 1; i < hi; i++) {
+            for (int j = i; j > lo && compare(a[j], a[j - 1], d) < 0; j--) {
+                swap(a[j], a[j - 1]);
+            }
+        }
+        return;
+    }
+
+    // median of three pseudo-random keys, fixed positions degrade to quadratic
+    // time on partially ordered input such as log lines
+    uint64_t seed = (uint64_t)lo * 0x9E3779B97F4A7C15ull ^ (uint64_t)hi * 0xBF58476D1CE4E5B9ull ^ d;
+    seed ^= seed >> 31;
+    seed *= 0x94D049BB133111EBull;
+    seed ^= seed >> 29;
+    uint64_t p1 = a[lo + seed % (hi - lo)].prefix;
+    uint64_t p2 = a[lo + (seed >> 21) % (hi - lo)].prefix;
+    uint64_t p3 = a[lo + (seed >> 42) % (hi - lo)].prefix;
+    uint64_t v = max(min(p1, p2), min(max(p1, p2), p3));
+
+    // a[lo..lt-1] < v = a[lt..gt] < a[gt+1..hi-1]
+    int lt = lo;
+    int gt = hi - 1;
+    int i = lo;
+    while (i <= gt) {
+        uint64_t t = a[i].prefix;
+        if (t < v) {
+            swap(a[lt++], a[i++]);
+        } else if (t > v) {
+            swap(a[i], a[gt--]);
+        } else {
+            i++;
+        }
+    }
+
+    cachedSort(a, lo, lt, d);
+    cachedSort(a, gt + 1, hi, d);
+
+    // equal prefixes: keys ending within the prefix are ordered by length and
+    // are equal to each other for the same length, the rest go deeper
+    int longer = gt + 1;
+    for (int k = gt; k >= lt; k--) {
+        if (a[k].length - d >= 8) {
+            swap(a[k], a[--longer]);
+        }
+    }
+
+    std::sort(a.begin() + lt, a.begin() + longer, [](const StringRecord &r1, const StringRecord &r2) {
+        return r1.length < r2.length;
+    });
+
+    if (gt + 1 - longer > 1) {
+        for (int k = longer; k <= gt; k++) {
+            a[k].prefix = loadPrefix(a[k].key, a[k].length, d + 8);
+        }
+        cachedSort(a, longer, gt + 1, d + 8);
+    }
+}
+
+void cachedSort(vector<StringRecord> &a) {
+    for (StringRecord &r : a) {
+        r.prefix = loadPrefix(r.key, r.length, 0);
+    }
+    cachedSort(a, 0, a.size(), 0);
+}
+
+// NUL terminated keys through records
+void cachedSort(vector<const char *> &a) {
+    vector<StringRecord> records(a.size());
+    for (int i = 0; i < (int)a.size(); i++) {
+        records[i].key = a[i];
+        records[i].length = strlen(a[i]);
+    }
+
+    cachedSort(records);
+
+    for (int i = 0; i < (int)a.size(); i++) {
+        a[i] = records[i].key;
+    }
+}
+
+
+enum class StringSortAlgorithm {
+    MULTIKEY_QUICKSORT,
+    MSD_RADIX,
+    PREFIX_CACHED,
+    PARALLEL    // all hardware threads
+};
+
+void sort(vector<const char *> &a, StringSortAlgorithm algorithm) {
+    switch (algorithm) {
+    case StringSortAlgorithm::MULTIKEY_QUICKSORT:
+        sort(a);
+        break;
+    case StringSortAlgorithm::MSD_RADIX:
+        msdRadixSort(a);
+        break;
+    case StringSortAlgorithm::PREFIX_CACHED:
+        cachedSort(a);
+        break;
+    case StringSortAlgorithm::PARALLEL:
+        parallelSort(a, max(1u, thread::hardware_concurrency()));
+        break;
+    }
+}
+
+
+// External memory sort of newline-delimited files larger than RAM.
+// Input is read in chunks of runBytes, every chunk is sorted in memory as
+// explicit-length records (lines may contain NUL bytes) with prefix-cached
+// quicksort and written as a run file, runs are merged by LCP loser
+// tree, at most EXTERNAL_MERGE_FAN_IN at a time: with more runs the merge
+// takes several passes through intermediate runs. Run readers and output
+// writer are double-buffered: every reader and writer owns one I/O thread
+// that fills (drains) the back buffer while the front one is consumed,
+// buffers are handed over under a mutex.
+const size_t EXTERNAL_IO_BUFFER = 1 << 20;
+const int EXTERNAL_MERGE_FAN_IN = 128; // runs merged at once
+
+// reads lines of a file, next buffer is read ahead by the reader's I/O thread
+class LineReader {
+    FILE *mFile;
+    vector<char> mBuffers[2];
+    int mCurrent = 1;
+    size_t mSize = 0;   // valid bytes in current buffer
+    size_t mPos = 0;
+    bool mEnd = false;
+
+    // shared with the I/O thread
+    mutex mLock;
+    condition_variable mChanged;
+    bool mWanted = true;    // back buffer should be filled
+    bool mReady = false;    // back buffer is filled
+    bool mStop = false;
+    bool mFailed = false;
+    size_t mReadySize = 0;
+    thread mThread;
+
+    void run() {
+        unique_lock<mutex> lock(mLock);
+        while (true) {
+            mChanged.wait(lock, [this]() { return mWanted || mStop; });
+            if (mStop) {
+                return;
+            }
+            mWanted = false;
+            vector<char> &buffer = mBuffers[1 - mCurrent];
+            lock.unlock();
+
+            size_t size = fread(buffer.data(), 1, buffer.size(), mFile);
+            bool failed = size < buffer.size() && ferror(mFile);
+
+            lock.lock();
+            mReadySize = size;
+            mFailed = mFailed || failed;
+            mReady = true;
+            mChanged.notify_all();
+        }
+    }
+
+    bool refill() {
+        if (mEnd) {
+            return false;
+        }
+
+        unique_lock<mutex> lock(mLock);
+        mChanged.wait(lock, [this]() { return mReady; });
+        mReady = false;
+        if (!mReadySize) {
+            mEnd = true;
+            return false;
+        }
+        mCurrent = 1 - mCurrent;
+        mSize = mReadySize;
+        mPos = 0;
+        mWanted = true;
+        mChanged.notify_all();
+        return true;
+    }
+
+public:
+    LineReader(FILE *file, size_t bufferBytes = EXTERNAL_IO_BUFFER) : mFile(file) {
+        mBuffers[0].resize(bufferBytes);
+        mBuffers[1].resize(bufferBytes);
+        mThread = thread(&LineReader::run, this);
+    }
+
+    ~LineReader() {
+        {
+            lock_guard<mutex> lock(mLock);
+            mStop = true;
+        }
+        mChanged.notify_all();
+        mThread.join();
+    }
+
+    // true if reading the file failed, read() then stops early
+    bool failed() {
+        lock_guard<mutex> lock(mLock);
+        return mFailed;
+    }
+
+    // next line without newline, false at the end of file
+    bool read(string &line) {
+        line.clear();
+        bool any = false;
+        while (true) {
+            if (mPos == mSize && !refill()) {
+                return any;
+            }
+
+            const char *start = mBuffers[mCurrent].data() + mPos;
+            const char *newline = (const char *)memchr(start, '\n', mSize - mPos);
+            if (newline) {
+                line.append(start, newline - start);
+                mPos += newline - start + 1;
+                return true;
+            }
+
+            line.append(start, mSize - mPos);
+            mPos = mSize;
+            any = true;
+        }
+    }
+};
+
+// writes lines to a file, full buffer is written by the writer's I/O thread
+class LineWriter {
+    FILE *mFile;
+    vector<char> mBuffers[2];
+    int mCurrent = 0;
+    size_t mCapacity;
+
+    // shared with the I/O thread
+    mutex mLock;
+    condition_variable mChanged;
+    bool mPending = false;  // back buffer waits to be written
+    bool mStop = false;
+    bool mFailed = false;
+    thread mThread;
+
+    void run() {
+        unique_lock<mutex> lock(mLock);
+        while (true) {
+            mChanged.wait(lock, [this]() { return mPending || mStop; });
+            if (!mPending) {
+                return;
+            }
+            vector<char> &buffer = mBuffers[1 - mCurrent];
+            lock.unlock();
+
+            bool failed = fwrite(buffer.data(), 1, buffer.size(), mFile) != buffer.size();
+            buffer.clear();
+
+            lock.lock();
+            mPending = false;
+            mFailed = mFailed || failed;
+            mChanged.notify_all();
+        }
+    }
+
+public:
+    LineWriter(FILE *file, size_t bufferBytes = EXTERNAL_IO_BUFFER) : mFile(file), mCapacity(bufferBytes) {
+        mBuffers[0].reserve(bufferBytes);
+        mBuffers[1].reserve(bufferBytes);
+        mThread = thread(&LineWriter::run, this);
+    }
+
+    ~LineWriter() {
+        close();
+    }
+
+    // writes everything out and stops the I/O thread, false if any write failed.
+    // The file itself stays open, fclose() result is the caller's to check
+    bool close() {
+        if (!mThread.joinable()) {
+            return !mFailed;
+        }
+
+        flush();
+        {
+            lock_guard<mutex> lock(mLock);
+            mStop = true;
+        }
+        mChanged.notify_all();
+        mThread.join();
+
+        if (fflush(mFile) != 0) {
+            mFailed = true;
+        }
+        return !mFailed;
+    }
+
+    void write(const char *line, size_t length) {
+        vector<char> &buffer = mBuffers[mCurrent];
+        if (buffer.size() + length + 1 > mCapacity && !buffer.empty()) {
+            flush();
+        }
+        mBuffers[mCurrent].insert(mBuffers[mCurrent].end(), line, line + length);
+        mBuffers[mCurrent].push_back('\n');
+    }
+
+    // hands the current buffer to the I/O thread once it is done with the other one
+    void flush() {
+        unique_lock<mutex> lock(mLock);
+        mChanged.wait(lock, [this]() { return !mPending; });
+        if (mBuffers[mCurrent].empty()) {
+            return;
+        }
+        mCurrent = 1 - mCurrent;
+        mPending = true;
+        mChanged.notify_all();
+    }
+};
+
+// k-way merge of sorted runs. Every run's current line keeps its LCP with the
+// last output line, losers in the tree keep LCP with the winner of their
+// subtree, so most comparisons are decided by LCP values alone and the rest
+// start at the common prefix.
+class LcpLoserTree {
+    vector<LineReader *> mRuns;
+    vector<string> mCurrent;
+    vector<int> mLcp;
+    vector<char> mDone;
+    vector<int> mTree;  // mTree[v] - loser at node v
+    int mLeaves;
+    int mWinner;
+    string mNext;
+
+    // returns winner, sets LCP of the loser to its LCP with the winner
+    int play(int a, int b) {
+        if (mDone[a]) {
+            return b;
+        }
+        if (mDone[b]) {
+            return a;
+        }
+        if (mLcp[a] != mLcp[b]) {
+            // larger LCP with last output means smaller string
+            return mLcp[a] > mLcp[b] ? a : b;
+        }
+
+        const string &s1 = mCurrent[a];
+        const string &s2 = mCurrent[b];
+        size_t h = mLcp[a];
+        size_t common = min(s1.size(), s2.size());
+        while (h < common && s1[h] == s2[h]) {
+            h++;
+        }
+
+        bool aWins = h == s1.size() || (h < s2.size() && (unsigned char)s1[h] < (unsigned char)s2[h]);
+        int winner = aWins ? a : b;
+        mLcp[aWins ? b : a] = h;
+        return winner;
+    }
+
+    void advance(int run) {
+        if (!mRuns[run]->read(mNext)) {
+            mDone[run] = true;
+            return;
+        }
+
+        const string &last = mCurrent[run];
+        size_t h = 0;
+        size_t common = min(last.size(), mNext.size());
+        while (h < common && last[h] == mNext[h]) {
+            h++;
+        }
+        mLcp[run] = h;
+        mCurrent[run].swap(mNext);
+    }
+
+public:
+    LcpLoserTree(const vector<LineReader *> &runs) : mRuns(runs) {
+        mLeaves = 1;
+        while (mLeaves < (int)runs.size()) {
+            mLeaves <<= 1;
+        }
+
+        mCurrent.resize(mLeaves);
+        mLcp.assign(mLeaves, 0);
+        mDone.assign(mLeaves, true);
+        for (int i = 0; i < (int)runs.size(); i++) {
+            mDone[i] = !runs[i]->read(mCurrent[i]);
+        }
+
+        mTree.resize(mLeaves);
+        vector<int> winners(2 * mLeaves);
+        for (int i = 0; i < mLeaves; i++) {
+            winners[mLeaves + i] = i;
+        }
+        for (int v = mLeaves - 1; v > 0; v--) {
+            int a = winners[2 * v];
+            int b = winners[2 * v + 1];
+            winners[v] = play(a, b);
+            mTree[v] = winners[v] == a ? b : a;
+        }
+        mWinner = mLeaves > 1 ? winners[1] : 0;
+    }
+
+    bool empty() const {
+        return mDone[mWinner];
+    }
+
+    const string &top() const {
+        return mCurrent[mWinner];
+    }
+
+    // replaces top line with the next line of its run
+    void pop() {
+        int contender = mWinner;
+        advance(contender);
+
+        for (int v = (contender + mLeaves) / 2; v > 0; v /= 2) {
+            int winner = play(contender, mTree[v]);
+            mTree[v] = winner == contender ? mTree[v] : contender;
+            contender = winner;
+        }
+        mWinner = contender;
+    }
+};
+
+static void removeFiles(const vector<string> &paths) {
+    for (const string &path : paths) {
+        remove(path.c_str());
+    }
+}
+
+// merges sorted run files into outputPath, false on any I/O error
+static bool mergeRuns(const vector<string> &runPaths, const string &outputPath, size_t bufferBytes) {
+    bool done = true;
+    vector<FILE *> files;
+    vector<LineReader *> readers;
+    for (const string &path : runPaths) {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file) {
+            done = false;
+            break;
+        }
+        files.push_back(file);
+        readers.push_back(new LineReader(file, bufferBytes));
+    }
+
+    FILE *output = done ? fopen(outputPath.c_str(), "wb") : nullptr;
+    if (output) {
+        LineWriter writer(output);
+        LcpLoserTree tree(readers);
+        while (!tree.empty()) {
+            writer.write(tree.top().data(), tree.top().size());
+            tree.pop();
+        }
+        done = writer.close();
+        done = fclose(output) == 0 && done;
+    } else {
+        done = false;
+    }
+
+    for (int i = 0; i < (int)readers.size(); i++) {
+        done = done && !readers[i]->failed();
+        delete readers[i];
+        fclose(files[i]);
+    }
+    return done;
+}
+
+// sorts lines of inputPath into outputPath, using about runBytes of memory
+// for line storage, run files are created next to the output and removed.
+// Returns false on any read or write error, run files are removed then too
+bool externalSort(const string &inputPath, const string &outputPath, size_t runBytes = 256 << 20,
+                  int fanIn = EXTERNAL_MERGE_FAN_IN) {
+    FILE *input = fopen(inputPath.c_str(), "rb");
+    if (!input) {
+        return false;
+    }
+
+    vector<string> runPaths;
+    size_t budget = max<size_t>(runBytes, 1);
+    vector<char> chunk(budget);
+    size_t filled = 0;
+    bool eof = false;
+
+    while (!eof) {
+        size_t got = fread(chunk.data() + filled, 1, chunk.size() - filled, input);
+        if (ferror(input)) {
+            fclose(input);
+            removeFiles(runPaths);
+            return false;
+        }
+        filled += got;
+        eof = filled < chunk.size();
+
+        // split on the last newline, the tail goes to the next chunk
+        size_t end = filled;
+        if (!eof) {
+            const char *p = chunk.data();
+            while (end > 0 && p[end - 1] != '\n') {
+                end--;
+            }
+            if (end == 0) { // line longer than chunk, grows only until it fits
+                chunk.resize(chunk.size() * 2);
+                continue;
+            }
+        }
+
+        // lines keep explicit lengths, NUL bytes inside them are ordinary characters
+        vector<StringRecord> lines;
+        size_t begin = 0;
+        for (size_t i = 0; i <= end; i++) {
+            if (i == end ? begin < end : chunk[i] == '\n') { // last line may have no newline
+                if (i - begin > UINT32_MAX) {
+                    fclose(input);
+                    removeFiles(runPaths);
+                    return false;
+                }
+                lines.push_back(StringRecord{chunk.data() + begin, 0, (uint32_t)(i - begin)});
+                begin = i + 1;
+            }
+        }
+
+        if (lines.empty() && !runPaths.empty()) {
+            break;
+        }
+
+        cachedSort(lines);
+
+        bool single = eof && runPaths.empty();
+        string path = single ? outputPath : outputPath + ".run" + to_string(runPaths.size());
+        FILE *output = fopen(path.c_str(), "wb");
+        bool written = output != nullptr;
+        if (output) {
+            LineWriter writer(output);
+            for (const StringRecord &line : lines) {
+                writer.write(line.key, line.length);
+            }
+            written = writer.close();
+            written = fclose(output) == 0 && written;
+        }
+
+        if (!written) {
+            fclose(input);
+            removeFiles(runPaths);
+            return false;
+        }
+        if (single) {
+            fclose(input);
+            return true;
+        }
+        runPaths.push_back(path);
+
+        memmove(chunk.data(), chunk.data() + end, filled - end);
+        filled -= end;
+
+        // a long line grew the chunk, go back to the budget
+        if (chunk.size() > budget) {
+            chunk.resize(max(budget, filled));
+            chunk.shrink_to_fit();
+        }
+    }
+    fclose(input);
+
+    // every pass merges groups of at most fanIn runs, so open files and
+    // reader threads stay bounded, intermediate runs go to the next pass
+    fanIn = max(fanIn, 2);
+    size_t created = runPaths.size();
+    while (true) {
+        bool last = (int)runPaths.size() <= fanIn;
+
+        // merge buffers of one group share the memory budget
+        size_t bufferBytes = runBytes / (2 * min<size_t>(runPaths.size(), fanIn));
+        bufferBytes = min(max<size_t>(bufferBytes, 4096), EXTERNAL_IO_BUFFER);
+
+        vector<string> merged;
+        for (size_t from = 0; from < runPaths.size(); from += fanIn) {
+            vector<string> group(runPaths.begin() + from, runPaths.begin() + min(from + fanIn, runPaths.size()));
+            if (group.size() == 1 && !last) { // nothing to merge, goes to the next pass as is
+                merged.push_back(group[0]);
+                continue;
+            }
+
+            string path = last ? outputPath : outputPath + ".run" + to_string(created++);
+            bool done = mergeRuns(group, path, bufferBytes);
+            if (!last) {
+                merged.push_back(path);
+            }
+            if (!done) {
+                removeFiles(merged);
+                removeFiles(vector<string>(runPaths.begin() + from, runPaths.end()));
+                return false;
+            }
+            removeFiles(group);
+        }
+
+        if (last) {
+            return true;
+        }
+        runPaths.swap(merged);
+    }
+}
+
+
+class StringSortTester {
+
+    static vector<const char *> pointers(const vector<string> &keys) {
+        vector<const char *> a;
+        for (const string &key : keys) {
+            a.push_back(key.c_str());
+        }
+        return a;
+    }
+
+    static bool sorted(const vector<const char *> &a, const vector<string> &keys) {
+        vector<string> expected = keys;
+        std::sort(expected.begin(), expected.end());
+        for (int i = 0; i < (int)a.size(); i++) {
+            if (expected[i] != a[i]) {
+                return false;
+            }
+        }
+        return a.size() == keys.size();
+    }
+
+public:
+    static vector<string> urls(int n, mt19937 &rnd) {
+        const char *hosts[] = {"www.example.com", "cdn.example.com", "api.example.org", "shop.example.net"};
+        const char *dirs[] = {"images", "static", "v1/users", "v2/orders", "search", "blog/2026"};
+        vector<string> keys(n);
+        for (string &key : keys) {
+            key = string("https://") + hosts[rnd() % 4] + "/" + dirs[rnd() % 6] + "/" + to_string(rnd() % 1000000) + "?id=" + to_string(rnd());
+        }
+        return keys;
+    }
+
+    static vector<string> logLines(int n, mt19937 &rnd) {
+        const char *levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+        vector<string> keys(n);
+        for (int i = 0; i < n; i++) {
+            // timestamps grow slowly, so many lines share long prefixes
+            int t = (long long)i * 86400 / n;
+            char time[32];
+            snprintf(time, sizeof(time), "2026-10-19 %02d:%02d:%02d.%03d", t / 3600, t / 60 % 60, t % 60, (int)(rnd() % 1000));
+            keys[i] = string(time) + " " + levels[rnd() % 4] + " [worker-" + to_string(rnd() % 32) + "] request " + to_string(rnd()) + " done";
+        }
+        return keys;
+    }
+
+    static vector<string> randomSuffixes(int n, mt19937 &rnd) {
+        string prefix(20, 'x');
+        vector<string> keys(n);
+        for (string &key : keys) {
+            key = prefix.substr(0, rnd() % 21);
+            int len = rnd() % 20;
+            for (int i = 0; i < len; i++) {
+                key += char('a' + rnd() % 26);
+            }
+        }
+        return keys;
+    }
+
+    static void t1() {
+        mt19937 rnd(1);
+
+        for (int n : {0, 1, 2, 10, 100, 1000, 70000, 200000}) {
+            vector<string> keys(n);
+            for (string &key : keys) {
+                int len = rnd() % 12;
+                for (int i = 0; i < len; i++) { // small and full byte alphabets
+                    key += char(1 + rnd() % (rnd() % 2 ? 3 : 255));
+                }
+            }
+
+            vector<const char *> a = pointers(keys);
+            sort(a, StringSortAlgorithm::MULTIKEY_QUICKSORT);
+            assert(sorted(a, keys));
+
+            a = pointers(keys);
+            sort(a, StringSortAlgorithm::MSD_RADIX);
+            assert(sorted(a, keys));
+
+            a = pointers(keys);
+            sort(a, StringSortAlgorithm::PREFIX_CACHED);
+            assert(sorted(a, keys));
+
+            for (int threads : {1, 2, 3, 8}) {
+                a = pointers(keys);
+                parallelSort(a, threads);
+                assert(sorted(a, keys));
+            }
+        }
+
+        cout << "t1 passed" << endl;
+    }
+
+    // binary keys with zero bytes and explicit lengths
+    static void t2() {
+        mt19937 rnd(2);
+
+        for (int n : {0, 1, 2, 10, 100, 1000, 50000}) {
+            vector<string> keys(n);
+            for (string &key : keys) {
+                int len = rnd() % 24;
+                for (int i = 0; i < len; i++) {
+                    key += char(rnd() % (rnd() % 2 ? 2 : 256));
+                }
+            }
+
+            vector<StringRecord> records(n);
+            for (int i = 0; i < n; i++) {
+                records[i].key = keys[i].data();
+                records[i].length = keys[i].size();
+            }
+            cachedSort(records);
+
+            vector<string> expected = keys;
+            std::sort(expected.begin(), expected.end());
+            for (int i = 0; i < n; i++) {
+                assert(expected[i] == string(records[i].key, records[i].length));
+            }
+        }
+
+        cout << "t2 passed" << endl;
+    }
+
+    static vector<string> readLines(const string &path, size_t bufferBytes = EXTERNAL_IO_BUFFER) {
+        vector<string> lines;
+        FILE *file = fopen(path.c_str(), "rb");
+        assert(file);
+        {
+            LineReader reader(file, bufferBytes);
+            string line;
+            while (reader.read(line)) {
+                lines.push_back(line);
+            }
+        }
+        fclose(file);
+        return lines;
+    }
+
+    static void writeFile(const string &path, const string &content) {
+        FILE *file = fopen(path.c_str(), "wb");
+        assert(file);
+        fwrite(content.data(), 1, content.size(), file);
+        fclose(file);
+    }
+
+    static void t3(const string &directory = "/tmp") {
+        mt19937 rnd(3);
+        string input = directory + "/stringsort_t3_input.txt";
+        string output = directory + "/stringsort_t3_output.txt";
+
+        for (size_t runBytes : {1, 100, 1000, 1 << 20}) {
+            for (int n : {0, 1, 5, 300}) {
+                vector<string> keys = n > 100 ? urls(n, rnd) : randomSuffixes(n, rnd);
+                string content;
+                for (const string &key : keys) {
+                    content += key + "\n";
+                }
+                if (n % 2 && !content.empty()) { // last line without newline
+                    content.pop_back();
+                }
+
+                writeFile(input, content);
+                assert(externalSort(input, output, runBytes));
+
+                std::sort(keys.begin(), keys.end());
+                assert(readLines(output, 7) == keys);
+            }
+        }
+
+        // small fan-in, merge takes several passes
+        vector<string> keys = urls(300, rnd);
+        string content;
+        for (const string &key : keys) {
+            content += key + "\n";
+        }
+        writeFile(input, content);
+        std::sort(keys.begin(), keys.end());
+        for (int fanIn : {2, 3, 16}) {
+            assert(externalSort(input, output, 100, fanIn));
+            assert(readLines(output) == keys);
+            FILE *run = fopen((output + ".run0").c_str(), "rb");
+            assert(!run);
+        }
+
+        // NUL bytes are ordinary characters, in one run and across runs
+        vector<string> binary = {string("b\0c", 3), string("b", 1), string("\0", 1), string("b\0", 2), string("a\0\0z", 4)};
+        content.clear();
+        for (const string &key : binary) {
+            content += key + "\n";
+        }
+        writeFile(input, content);
+        std::sort(binary.begin(), binary.end());
+        for (size_t runBytes : {1, 1 << 20}) {
+            assert(externalSort(input, output, runBytes));
+            assert(readLines(output) == binary);
+        }
+
+        // write errors are reported, not left as a truncated output
+        FILE *full = fopen("/dev/full", "wb");
+        if (full) {
+            fclose(full);
+            writeFile(input, "b\na\n");
+            assert(!externalSort(input, "/dev/full"));
+        }
+        assert(!externalSort(input, directory + "/no such directory/output.txt", 1));
+
+        remove(input.c_str());
+        remove(output.c_str());
+
+        cout << "t3 passed" << endl;
+    }
+
+    static void benchmark(int n = 2000000) {
+        mt19937 rnd(42);
+        const char *names[] = {"urls", "log lines", "random suffixes"};
+        vector<string> datasets[] = {urls(n, rnd), logLines(n, rnd), randomSuffixes(n, rnd)};
+
+        for (int k = 0; k < 3; k++) {
+            const vector<string> &keys = datasets[k];
+            cout << names[k] << ":" << endl;
+
+            auto measure = [&](const string &name, function<void(vector<const char *> &)> sorter) {
+                vector<const char *> a = pointers(keys);
+                auto start = chrono::steady_clock::now();
+                sorter(a);
+                auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+                assert(sorted(a, keys));
+                cout << "    " << name << ":\t" << elapsed.count() << " ms" << endl;
+            };
+
+            measure("multikey quicksort", [](vector<const char *> &a) { sort(a, StringSortAlgorithm::MULTIKEY_QUICKSORT); });
+            measure("msd radix", [](vector<const char *> &a) { sort(a, StringSortAlgorithm::MSD_RADIX); });
+            measure("prefix cached", [](vector<const char *> &a) { sort(a, StringSortAlgorithm::PREFIX_CACHED); });
+            for (int threads = 1; threads <= 32; threads *= 2) {
+                measure("parallel, " + to_string(threads) + " threads", [threads](vector<const char *> &a) { parallelSort(a, threads); });
+            }
+        }
+    }
+
+    // end to end external sort throughput, runBytes much smaller than input
+    static void benchmarkExternal(int n = 4000000, size_t runBytes = 32 << 20, const string &directory = "/tmp") {
+        mt19937 rnd(42);
+        string input = directory + "/stringsort_bench_input.txt";
+        string output = directory + "/stringsort_bench_output.txt";
+
+        vector<string> keys = urls(n, rnd);
+        string content;
+        for (const string &key : keys) {
+            content += key + "\n";
+        }
+        writeFile(input, content);
+        keys.clear();
+
+        auto start = chrono::steady_clock::now();
+        bool done = externalSort(input, output, runBytes);
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        assert(done);
+
+        vector<string> lines = readLines(output);
+        assert((int)lines.size() == n);
+        assert(is_sorted(lines.begin(), lines.end()));
+
+        double mb = content.size() / 1048576.0;
+        cout << "external sort: " << mb << " MB in " << elapsed.count() << " ms, "
+             << mb * 1000 / max<long long>(elapsed.count(), 1) << " MB/s" << endl;
+
+        remove(input.c_str());
+        remove(output.c_str());
+    }
+
+    static void main() {
+        t1();
+        t2();
+        t3();
+
+        cout << "cool!" << endl;
+    }
+};
@@ -1,109 +1,1174 @@
 #include <iostream>
 #include <cstring>
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-class TST {
-    struct Node {
-        char c;
+template <typename Value>
+class FrozenTST;
+
+// One lookup of a batch: remaining key and node it is about to visit.
+struct TSTLookup {
+    const unsigned char *key;
+    uint32_t node;
+    int index;
+};
 
-        Node *left = nullptr;
-        Node *mid = nullptr;
-        Node *right = nullptr;
+// Batch lookup interleaving GROUP keys, AMAC style: each step moves one key
+// by one dependent load and prefetches what that key reads next, so cache
+// misses of different keys overlap instead of running back to back.
+// Tree provides start(lookup) and step(lookup) returning -1 while running,
+// otherwise 1 if key is present and 0 if not.
+template <typename Tree>
+void tstContainsMany(const Tree &tree, const vector<const char *> &keys, vector<uint8_t> &out, int from, int to)
+{
+    const int GROUP = 16;
+    TSTLookup inFlight[GROUP];
+    int active = 0;
+    int next = from;
 
-        bool set = false;
+    while (active < GROUP && next < to) {
+        TSTLookup &lookup = inFlight[active++];
+        lookup.key = (const unsigned char *)keys[next];
+        lookup.index = next++;
+        tree.start(lookup);
+    }
 
-#if 1
-        ~Node() {
-            delete left;
-            delete mid;
-            delete right;
+    while (active) {
+        for (int i = 0; i < active; ) {
+            int found = tree.step(inFlight[i]);
+            if (found < 0) {
+                i++;
+                continue;
+            }
+
+            out[inFlight[i].index] = found;
+            if (next < to) {
+                inFlight[i].key = (const unsigned char *)keys[next];
+                inFlight[i].index = next++;
+                tree.start(inFlight[i]);
+                i++;
+            } else {
+                inFlight[i] = inFlight[--active];
+            }
         }
-#endif
+    }
+}
+
+// Ternary search tree map from strings to Value. Nodes live in one contiguous
+// arena and link to each other by 32-bit indices, index 0 is null. All
+// traversals are iterative, the whole tree is freed at once.
+// Values are kept in a separate vector, node refers to its value by index,
+// removed keys leave their nodes in place and recycle the value slot.
+template <typename Value = bool>
+class TST {
+    struct Node {
+        uint32_t left = 0;
+        uint32_t mid = 0;
+        uint32_t right = 0;
+        uint32_t value = 0;     // index in mValues, 0 - no key ends here
+
+        unsigned char c = 0;
     };
 
+    vector<Node> mNodes = vector<Node>(1);      // mNodes[0] is null node
+    vector<Value> mValues = vector<Value>(1);   // mValues[0] is unused
+    vector<uint32_t> mFreeValues;
     int mSize = 0;
-    Node *mRoot = nullptr;
+    uint32_t mRoot = 0;
 
-    Node *get(Node *n, const char *key, int keyLen) {
-        if (!keyLen || !n) {
-            return nullptr;
-        }
+    uint32_t make(unsigned char c) {
+        assert(mNodes.size() < UINT32_MAX);
+        mNodes.push_back(Node());
+        mNodes.back().c = c;
+        return mNodes.size() - 1;
+    }
+
+    template <typename Tree>
+    friend void tstContainsMany(const Tree &, const vector<const char *> &, vector<uint8_t> &, int, int);
 
-        char c = *key;
+    void start(TSTLookup &lookup) const {
+        lookup.node = *lookup.key ? mRoot : 0;
+    }
+
+    int step(TSTLookup &lookup) const {
+        if (!lookup.node) {
+            return 0;
+        }
 
-        if (c < n->c) {
-            return get(n->left, key, keyLen);
-        } else if (c > n->c) {
-            return get(n->right, key, keyLen);
-        } else if (keyLen > 1) {
-            return get(n->mid, key + 1, keyLen - 1);
+        const Node &node = mNodes[lookup.node];
+        unsigned char c = *lookup.key;
+        if (c < node.c) {
+            lookup.node = node.left;
+        } else if (c > node.c) {
+            lookup.node = node.right;
+        } else if (lookup.key[1]) {
+            lookup.node = node.mid;
+            lookup.key++;
         } else {
-            return n;
+            return node.value ? 1 : 0;
         }
+
+        __builtin_prefetch(&mNodes[lookup.node]);
+        return -1;
     }
 
-    Node *put(Node *n, const char *key, int keyLen) {
+    uint32_t makeValue(const Value &value) {
+        if (!mFreeValues.empty()) {
+            uint32_t v = mFreeValues.back();
+            mFreeValues.pop_back();
+            mValues[v] = value;
+            return v;
+        }
+        mValues.push_back(value);
+        return mValues.size() - 1;
+    }
+
+    uint32_t get(const char *key, int keyLen) const {
         if (!keyLen) {
-            return nullptr;
+            return 0;
         }
 
-        char c = *key;
+        uint32_t n = mRoot;
+        while (n) {
+            const Node &node = mNodes[n];
+            unsigned char c = *key;
 
-        if (!n) {
-            n = new Node();
-            n->c = c;
+            if (c < node.c) {
+                n = node.left;
+            } else if (c > node.c) {
+                n = node.right;
+            } else if (keyLen > 1) {
+                n = node.mid;
+                key++;
+                keyLen--;
+            } else {
+                return n;
+            }
+        }
+
+        return 0;
+    }
+
+    // single pass insert or assign, returns true if key was not in the tree
+    bool put(const char *key, int keyLen, const Value &value) {
+        if (!keyLen) {
+            return false;
+        }
+
+        if (!mRoot) {
+            mRoot = make(*key);
+        }
+
+        // make() may reallocate the arena, so nodes are addressed by index
+        uint32_t n = mRoot;
+        while (true) {
+            unsigned char c = *key;
+            uint32_t next;
+
+            if (c < mNodes[n].c) {
+                next = mNodes[n].left;
+                if (!next) {
+                    next = make(c);
+                    mNodes[n].left = next;
+                }
+            } else if (c > mNodes[n].c) {
+                next = mNodes[n].right;
+                if (!next) {
+                    next = make(c);
+                    mNodes[n].right = next;
+                }
+            } else if (keyLen > 1) {
+                key++;
+                keyLen--;
+                next = mNodes[n].mid;
+                if (!next) {
+                    next = make(*key);
+                    mNodes[n].mid = next;
+                }
+            } else {
+                if (mNodes[n].value) {
+                    mValues[mNodes[n].value] = value;
+                    return false;
+                }
+                mNodes[n].value = makeValue(value);
+                return true;
+            }
+
+            n = next;
         }
+    }
+
+public:
+    // Lazy in-order iterator over keys of a subtree, explicit stack instead
+    // of recursion. Every increment walks only until the next key.
+    class Iterator {
+        struct Frame {
+            uint32_t node;
+            uint32_t depth;     // key length before node's character
+            int stage;          // 0 - left, 1 - self, 2 - mid, 3 - right
+        };
+
+        const TST *mTree = nullptr;
+        vector<Frame> mStack;
+        string mKey;
+        uint32_t mCurrent = 0;
+
+        void advance() {
+            mCurrent = 0;
+            while (!mStack.empty() && !mCurrent) {
+                Frame &f = mStack.back();
+                const Node &n = mTree->mNodes[f.node];
+                uint32_t depth = f.depth;
+
+                switch (f.stage++) {
+                case 0:
+                    if (n.left) {
+                        mStack.push_back(Frame{n.left, depth, 0});
+                    }
+                    break;
+                case 1:
+                    mKey.resize(depth);
+                    mKey.push_back(n.c);
+                    mCurrent = n.value ? f.node : 0;
+                    break;
+                case 2:
+                    if (n.mid) {
+                        mStack.push_back(Frame{n.mid, depth + 1, 0});
+                    }
+                    break;
+                default:
+                    mStack.pop_back();
+                    if (n.right) {
+                        mStack.push_back(Frame{n.right, depth, 0});
+                    }
+                    break;
+                }
+            }
+        }
+
+    public:
+        Iterator() {}
+
+        // keys of subtree of node, all extending prefix; first is prefix itself if self is set
+        Iterator(const TST *tree, uint32_t node, const string &prefix, bool self) : mTree(tree), mKey(prefix) {
+            if (!node) {
+                return;
+            }
+
+            if (self) {
+                if (tree->mNodes[node].mid) {
+                    mStack.push_back(Frame{tree->mNodes[node].mid, (uint32_t)prefix.size(), 0});
+                }
+                if (tree->mNodes[node].value) {
+                    mCurrent = node;
+                    return;
+                }
+            } else {
+                mStack.push_back(Frame{node, (uint32_t)prefix.size(), 0});
+            }
+            advance();
+        }
+
+        const string &key() const {
+            return mKey;
+        }
+
+        const Value &value() const {
+            return mTree->mValues[mTree->mNodes[mCurrent].value];
+        }
+
+        const string &operator*() const {
+            return mKey;
+        }
+
+        Iterator &operator++() {
+            advance();
+            return *this;
+        }
+
+        bool operator==(const Iterator &other) const {
+            return mCurrent == other.mCurrent && mStack.size() == other.mStack.size();
+        }
+
+        bool operator!=(const Iterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    struct Range {
+        Iterator first;
+
+        Iterator begin() const {
+            return first;
+        }
+
+        Iterator end() const {
+            return Iterator();
+        }
+    };
+
+    int size() const {
+        return mSize;
+    }
+
+    // allocated nodes
+    int nodes() const {
+        return mNodes.size() - 1;
+    }
+
+    void reserve(int nodes) {
+        mNodes.reserve(nodes + 1);
+    }
+
+    // frees all nodes at once
+    void clear() {
+        mNodes.resize(1);
+        mValues.resize(1);
+        mFreeValues.clear();
+        mRoot = 0;
+        mSize = 0;
+    }
+
+    bool contains(const char *key) const {
+        uint32_t n = get(key, (int)strlen(key));
+        return n && mNodes[n].value;
+    }
+
+    // out[i] is 1 if keys[i] is in the tree, lookups are interleaved
+    void containsMany(const vector<const char *> &keys, vector<uint8_t> &out) const {
+        out.resize(keys.size());
+        tstContainsMany(*this, keys, out, 0, keys.size());
+    }
+
+    // value of key or nullptr
+    const Value *get(const char *key) const {
+        uint32_t n = get(key, (int)strlen(key));
+        return n && mNodes[n].value ? &mValues[mNodes[n].value] : nullptr;
+    }
 
-        if (c < n->c) {
-            n->left = put(n->left, key, keyLen);
-        } else if (c > n->c) {
-            n->right = put(n->right, key, keyLen);
-        } else if (keyLen > 1) {
-            n->mid = put(n->mid, key + 1, keyLen - 1);
+    // inserts key or assigns value of existing key, returns true if key is new
+    bool put(const char *key, const Value &value = Value()) {
+        if (put(key, (int)strlen(key), value)) {
+            mSize++;
+            return true;
+        }
+        return false;
+    }
+
+    bool remove(const char *key) {
+        uint32_t n = get(key, (int)strlen(key));
+        if (!n || !mNodes[n].value) {
+            return false;
+        }
+
+        mValues[mNodes[n].value] = Value();
+        mFreeValues.push_back(mNodes[n].value);
+        mNodes[n].value = 0;
+        mSize--;
+        return true;
+    }
+
+    // lazily enumerated keys starting with prefix, in sorted order
+    Range keysWithPrefix(const char *prefix) const {
+        int len = strlen(prefix);
+        if (!len) {
+            return Range{Iterator(this, mRoot, string(), false)};
+        }
+        return Range{Iterator(this, get(prefix, len), prefix, true)};
+    }
+
+    // longest key that is a prefix of query, empty string if there is none
+    string longestPrefixOf(const char *query) const {
+        int length = 0;
+        int depth = 0;
+        uint32_t n = mRoot;
+        while (n && query[depth]) {
+            const Node &node = mNodes[n];
+            unsigned char c = query[depth];
+
+            if (c < node.c) {
+                n = node.left;
+            } else if (c > node.c) {
+                n = node.right;
+            } else {
+                depth++;
+                if (node.value) {
+                    length = depth;
+                }
+                n = node.mid;
+            }
+        }
+        return string(query, length);
+    }
+
+    // keys matching pattern where '.' matches any character, in sorted order
+    vector<string> keysThatMatch(const char *pattern) const {
+        struct Frame {
+            uint32_t node;
+            uint32_t depth;     // matched pattern characters
+            uint32_t parent;    // node whose character is key[depth - 1] for mid links, 0 otherwise
+        };
+
+        vector<string> result;
+        int len = strlen(pattern);
+        if (!len || !mRoot) {
+            return result;
+        }
+
+        string key;
+        vector<Frame> stack(1, Frame{mRoot, 0, 0});
+        while (!stack.empty()) {
+            Frame f = stack.back();
+            stack.pop_back();
+
+            if (f.parent) {
+                key.resize(f.depth - 1);
+                key.push_back(mNodes[f.parent].c);
+            }
+            key.resize(f.depth);
+
+            const Node &n = mNodes[f.node];
+            unsigned char c = pattern[f.depth];
+            bool any = c == '.';
+
+            // pushed in reverse, so left subtree is taken first
+            if ((any || c > n.c) && n.right) {
+                stack.push_back(Frame{n.right, f.depth, 0});
+            }
+            if (any || c == n.c) {
+                if ((int)f.depth == len - 1) {
+                    if (n.value) {
+                        result.push_back(key + (char)n.c);
+                    }
+                } else if (n.mid) {
+                    stack.push_back(Frame{n.mid, f.depth + 1, f.node});
+                }
+            }
+            if ((any || c < n.c) && n.left) {
+                stack.push_back(Frame{n.left, f.depth, 0});
+            }
+        }
+
+        return result;
+    }
+
+    // immutable compact copy of the tree, see FrozenTST
+    FrozenTST<Value> freeze() const {
+        typedef typename FrozenTST<Value>::Node Frozen;
+
+        // preorder lists parents before children, so subtrees without keys
+        // (left after remove) are found in one reverse pass
+        vector<uint32_t> order;
+        vector<uint32_t> stack;
+        if (mRoot) {
+            stack.push_back(mRoot);
+        }
+        while (!stack.empty()) {
+            uint32_t n = stack.back();
+            stack.pop_back();
+            order.push_back(n);
+            for (uint32_t child : {mNodes[n].left, mNodes[n].mid, mNodes[n].right}) {
+                if (child) {
+                    stack.push_back(child);
+                }
+            }
+        }
+
+        vector<bool> alive(mNodes.size());
+        for (int i = (int)order.size() - 1; i >= 0; i--) {
+            const Node &n = mNodes[order[i]];
+            alive[order[i]] = n.value || alive[n.left] || alive[n.mid] || alive[n.right];
+        }
+
+        vector<Frozen> nodes(1);
+        vector<Value> values;
+        string labels;
+
+        // tree node to emit, frozen parent and which of its links points here
+        struct Frame {
+            uint32_t node;
+            uint32_t parent;
+            int link;
+        };
+
+        vector<Frame> frames;
+        if (alive[mRoot]) {
+            frames.push_back(Frame{mRoot, 0, 0});
+        }
+        while (!frames.empty()) {
+            Frame frame = frames.back();
+            frames.pop_back();
+
+            uint32_t f = nodes.size();
+            if (frame.parent) {
+                uint32_t Frozen::*links[] = {&Frozen::left, &Frozen::mid, &Frozen::right};
+                nodes[frame.parent].*links[frame.link] = f;
+            }
+
+            Frozen frozen = Frozen();
+            frozen.label = labels.size();
+
+            // chain of mid links without siblings and keys becomes one label
+            uint32_t first = frame.node;
+            uint32_t last = first;
+            labels.push_back(mNodes[first].c);
+            while (!mNodes[last].value && alive[mNodes[last].mid]) {
+                const Node &next = mNodes[mNodes[last].mid];
+                if (alive[next.left] || alive[next.right]) {
+                    break;
+                }
+                last = mNodes[last].mid;
+                labels.push_back(next.c);
+            }
+            frozen.length = labels.size() - frozen.label;
+
+            if (mNodes[last].value) {
+                values.push_back(mValues[mNodes[last].value]);
+                frozen.value = values.size();
+            }
+            nodes.push_back(frozen);
+
+            if (alive[mNodes[first].right]) {
+                frames.push_back(Frame{mNodes[first].right, f, 2});
+            }
+            if (alive[mNodes[last].mid]) {
+                frames.push_back(Frame{mNodes[last].mid, f, 1});
+            }
+            if (alive[mNodes[first].left]) {
+                frames.push_back(Frame{mNodes[first].left, f, 0});
+            }
+        }
+
+        return FrozenTST<Value>(nodes, values, labels);
+    }
+};
+
+// Immutable ternary search tree in one flat buffer: header, nodes in DFS
+// preorder, values, then labels. Chains of mid links with no siblings and no
+// keys are compressed into a single node with a multi-character label.
+// Links are indices into the buffer, so the same bytes work from memory and
+// from a file mapped with open() without deserialization. Value has to be
+// trivially copyable, the file is only portable between same-endian hosts.
+template <typename Value>
+class FrozenTST {
+    static_assert(is_trivially_copyable<Value>::value, "FrozenTST values are stored as raw bytes");
+
+public:
+    struct Node {
+        uint32_t left;
+        uint32_t mid;
+        uint32_t right;
+        uint32_t label;     // offset of first label character
+        uint32_t length;    // label characters
+        uint32_t value;     // 1-based index in values, 0 - no key ends here
+    };
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t size;
+        uint32_t nodes;     // including null node 0
+        uint64_t labels;
+        uint32_t valueSize;
+        uint32_t reserved;
+    };
+
+    static const char *magic() {
+        return "FROZTST1";
+    }
+
+    vector<char> mBuffer;           // owned bytes after freeze()
+    void *mMapped = nullptr;        // or bytes mapped by open()
+    size_t mMappedBytes = 0;
+
+    const Header *mHeader = nullptr;
+    const Node *mNodes = nullptr;
+    const Value *mValues = nullptr;     // mValues[0] is value 1
+    const unsigned char *mLabels = nullptr;
+
+    static size_t align(size_t offset) {
+        return (offset + 7) & ~(size_t)7;
+    }
+
+    static size_t valuesOffset(const Header &header) {
+        return align(sizeof(Header) + (size_t)header.nodes * sizeof(Node));
+    }
+
+    static size_t labelsOffset(const Header &header) {
+        return valuesOffset(header) + (size_t)header.size * sizeof(Value);
+    }
+
+    // checks header and every node once, so queries never leave the data,
+    // then points views into it; false if data is not a valid frozen tree
+    bool attach(const char *data, size_t bytes) {
+        if (bytes < sizeof(Header)) {
+            return false;
+        }
+
+        const Header *header = (const Header *)data;
+        if (memcmp(header->magic, magic(), 8) || header->valueSize != sizeof(Value) || !header->nodes ||
+            header->labels > UINT32_MAX || labelsOffset(*header) > bytes ||
+            labelsOffset(*header) + header->labels != bytes) {
+            return false;
+        }
+
+        // nodes are in preorder, links only point forward, so there are no cycles
+        const Node *nodes = (const Node *)(data + sizeof(Header));
+        for (uint32_t i = 1; i < header->nodes; i++) {
+            const Node &node = nodes[i];
+            for (uint32_t child : {node.left, node.mid, node.right}) {
+                if (child && (child <= i || child >= header->nodes)) {
+                    return false;
+                }
+            }
+            if (!node.length || (uint64_t)node.label + node.length > header->labels || node.value > header->size) {
+                return false;
+            }
+        }
+
+        mHeader = header;
+        mNodes = nodes;
+        mValues = (const Value *)(data + valuesOffset(*header));
+        mLabels = (const unsigned char *)(data + labelsOffset(*header));
+        return true;
+    }
+
+    void release() {
+        if (mMapped) {
+            munmap(mMapped, mMappedBytes);
+        }
+        mMapped = nullptr;
+        mMappedBytes = 0;
+        mBuffer.clear();
+        mHeader = nullptr;
+    }
+
+    template <typename Tree>
+    friend void tstContainsMany(const Tree &, const vector<const char *> &, vector<uint8_t> &, int, int);
+
+    void start(TSTLookup &lookup) const {
+        lookup.node = mHeader && mHeader->nodes > 1 && *lookup.key ? 1 : 0;
+    }
+
+    // labels are laid out in preorder like nodes, a separate stage to
+    // prefetch them measured slower than taking the miss
+    int step(TSTLookup &lookup) const {
+        if (!lookup.node) {
+            return 0;
+        }
+
+        const Node &node = mNodes[lookup.node];
+        const unsigned char *label = mLabels + node.label;
+        const unsigned char *k = lookup.key;
+        if (*k < *label) {
+            lookup.node = node.left;
+        } else if (*k > *label) {
+            lookup.node = node.right;
         } else {
-            n->set = true;
+            for (uint32_t i = 1; i < node.length; i++) {
+                if (k[i] != label[i]) {
+                    return 0;
+                }
+            }
+            lookup.key += node.length;
+            if (!*lookup.key) {
+                return node.value ? 1 : 0;
+            }
+            lookup.node = node.mid;
+        }
+
+        __builtin_prefetch(&mNodes[lookup.node]);
+        return -1;
+    }
+
+    // index of node where key ends or 0
+    uint32_t find(const char *key) const {
+        const unsigned char *k = (const unsigned char *)key;
+        if (!mHeader || !*k) {
+            return 0;
+        }
+
+        uint32_t n = mHeader->nodes > 1 ? 1 : 0;
+        while (n) {
+            const Node &node = mNodes[n];
+            const unsigned char *label = mLabels + node.label;
+
+            if (*k < *label) {
+                n = node.left;
+            } else if (*k > *label) {
+                n = node.right;
+            } else {
+                for (uint32_t i = 1; i < node.length; i++) {
+                    if (k[i] != label[i]) {
+                        return 0;
+                    }
+                }
+                k += node.length;
+                if (!*k) {
+                    return n;
+                }
+                n = node.mid;
+            }
         }
 
+        return 0;
+    }
+
+public:
+    FrozenTST() {}
+
+    // packs nodes (node 0 is null, node 1 is root) into a single buffer
+    FrozenTST(const vector<Node> &nodes, const vector<Value> &values, const string &labels) {
+        Header header = Header();
+        memcpy(header.magic, magic(), 8);
+        header.size = values.size();
+        header.nodes = nodes.size();
+        header.labels = labels.size();
+        header.valueSize = sizeof(Value);
+
+        mBuffer.resize(labelsOffset(header) + labels.size());
+        char *data = mBuffer.data();
+        memcpy(data, &header, sizeof(header));
+        memcpy(data + sizeof(Header), nodes.data(), nodes.size() * sizeof(Node));
+        // one by one, values may be vector<bool>
+        for (size_t i = 0; i < values.size(); i++) {
+            Value value = values[i];
+            memcpy(data + valuesOffset(header) + i * sizeof(Value), &value, sizeof(Value));
+        }
+        memcpy(data + labelsOffset(header), labels.data(), labels.size());
+
+        bool ok = attach(data, mBuffer.size());
+        assert(ok);
+        (void)ok;
+    }
+
+    FrozenTST(const FrozenTST &) = delete;
+    FrozenTST &operator=(const FrozenTST &) = delete;
+
+    FrozenTST(FrozenTST &&other) {
+        *this = move(other);
+    }
+
+    FrozenTST &operator=(FrozenTST &&other) {
+        if (this != &other) {
+            release();
+            mBuffer.swap(other.mBuffer);
+            mMapped = other.mMapped;
+            mMappedBytes = other.mMappedBytes;
+            mHeader = other.mHeader;
+            mNodes = other.mNodes;
+            mValues = other.mValues;
+            mLabels = other.mLabels;
+            other.mMapped = nullptr;
+            other.mMappedBytes = 0;
+            other.mHeader = nullptr;
+        }
+        return *this;
+    }
+
+    ~FrozenTST() {
+        release();
+    }
+
+    // writes the buffer as is, false on I/O error
+    bool save(const char *path) const {
+        if (!mHeader) {
+            return false;
+        }
+
+        FILE *file = fopen(path, "wb");
+        if (!file) {
+            return false;
+        }
+        size_t bytes = labelsOffset(*mHeader) + mHeader->labels;
+        bool ok = fwrite(mHeader, 1, bytes, file) == bytes;
+        return fclose(file) == 0 && ok;
+    }
+
+    // maps a file written by save() read-only, pages are shared between
+    // processes mapping the same file; false if file is missing or invalid
+    bool open(const char *path) {
+        release();
+
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        void *mapped = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+
+        mMapped = mapped;
+        mMappedBytes = st.st_size;
+        if (!attach((const char *)mapped, mMappedBytes)) {
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    bool mapped() const {
+        return mMapped != nullptr;
+    }
+
+    int size() const {
+        return mHeader ? mHeader->size : 0;
+    }
+
+    // nodes after path compression
+    int nodes() const {
+        return mHeader ? mHeader->nodes - 1 : 0;
+    }
+
+    size_t bytes() const {
+        return mHeader ? labelsOffset(*mHeader) + mHeader->labels : 0;
+    }
+
+    bool contains(const char *key) const {
+        uint32_t n = find(key);
+        return n && mNodes[n].value;
+    }
+
+    // out[i] is 1 if keys[i] is in the tree. The tree is never modified, so
+    // any number of threads may query it at once, here keys are split into
+    // one interleaved batch per thread.
+    void containsMany(const vector<const char *> &keys, vector<uint8_t> &out, int threads = 1) const {
+        out.resize(keys.size());
+
+        int n = keys.size();
+        threads = max(1, min(threads, n / 1024));
+        vector<thread> workers;
+        for (int t = 1; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                tstContainsMany(*this, keys, out, (long long)n * t / threads, (long long)n * (t + 1) / threads);
+            });
+        }
+        tstContainsMany(*this, keys, out, 0, n / threads);
+        for (thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    // value of key or nullptr
+    const Value *get(const char *key) const {
+        uint32_t n = find(key);
+        return n && mNodes[n].value ? &mValues[mNodes[n].value - 1] : nullptr;
+    }
+};
+
+// Ternary search tree set for concurrent use: any number of threads may call
+// put() and contains() at the same time. Readers take no locks. A node is
+// fully written before a release store or CAS links it into the tree, so a
+// reader that follows a link by acquire load sees it complete. Writers
+// claim an empty child slot by CAS, the loser of a race keeps its unlinked
+// node for the next empty slot it meets. Nodes are never freed while the
+// tree lives. The arena grows by fixed chunks that never move.
+class ConcurrentTST {
+    struct Node {
+        atomic<uint32_t> left{0};
+        atomic<uint32_t> mid{0};
+        atomic<uint32_t> right{0};
+        atomic<bool> set{false};
+
+        unsigned char c = 0;
+    };
+
+    static const int CHUNK_BITS = 16;
+    static const uint32_t CHUNK = 1u << CHUNK_BITS;
+    static const uint32_t MAX_CHUNKS = 1u << (32 - CHUNK_BITS);
+
+    unique_ptr<atomic<Node *>[]> mChunks;
+    atomic<uint32_t> mNext{1};      // node 0 is null
+    atomic<uint32_t> mRoot{0};
+    atomic<int> mSize{0};
+
+    Node &node(uint32_t n) const {
+        return mChunks[n >> CHUNK_BITS].load(memory_order_acquire)[n & (CHUNK - 1)];
+    }
+
+    uint32_t make(unsigned char c) {
+        uint32_t n = mNext.fetch_add(1, memory_order_relaxed);
+        assert(n < UINT32_MAX);
+
+        atomic<Node *> &chunk = mChunks[n >> CHUNK_BITS];
+        if (!chunk.load(memory_order_acquire)) {
+            Node *fresh = new Node[CHUNK];
+            Node *expected = nullptr;
+            if (!chunk.compare_exchange_strong(expected, fresh, memory_order_acq_rel)) {
+                delete[] fresh;
+            }
+        }
+
+        node(n).c = c;
         return n;
     }
 
+    // links spare node with character c into empty slot, or returns node another writer linked first
+    uint32_t link(atomic<uint32_t> &slot, unsigned char c, uint32_t &spare) {
+        if (!spare) {
+            spare = make(c);
+        }
+        node(spare).c = c;
+
+        uint32_t expected = 0;
+        if (slot.compare_exchange_strong(expected, spare, memory_order_acq_rel, memory_order_acquire)) {
+            uint32_t n = spare;
+            spare = 0;
+            return n;
+        }
+        return expected;
+    }
+
 public:
-    ~TST() {
-        delete mRoot;
+    ConcurrentTST() : mChunks(new atomic<Node *>[MAX_CHUNKS]) {
+        for (uint32_t i = 0; i < MAX_CHUNKS; i++) {
+            mChunks[i].store(nullptr, memory_order_relaxed);
+        }
     }
 
-    int size() {
-        return mSize;
+    ConcurrentTST(const ConcurrentTST &) = delete;
+    ConcurrentTST &operator=(const ConcurrentTST &) = delete;
+
+    ~ConcurrentTST() {
+        for (uint32_t i = 0; i < MAX_CHUNKS; i++) {
+            delete[] mChunks[i].load(memory_order_relaxed);
+        }
     }
 
-    bool contains(const char *key) {
-        Node *n = get(mRoot, key, (int)strlen(key));
-        if (n && n->set) {
-            return true;
+    int size() const {
+        return mSize.load(memory_order_relaxed);
+    }
+
+    // allocated nodes, including ones lost in races
+    int nodes() const {
+        return mNext.load(memory_order_relaxed) - 1;
+    }
+
+    bool contains(const char *key) const {
+        const unsigned char *k = (const unsigned char *)key;
+        if (!*k) {
+            return false;
+        }
+
+        uint32_t n = mRoot.load(memory_order_acquire);
+        while (n) {
+            const Node &current = node(n);
+            if (*k < current.c) {
+                n = current.left.load(memory_order_acquire);
+            } else if (*k > current.c) {
+                n = current.right.load(memory_order_acquire);
+            } else if (k[1]) {
+                n = current.mid.load(memory_order_acquire);
+                k++;
+            } else {
+                return current.set.load(memory_order_acquire);
+            }
         }
 
         return false;
     }
 
-    void put(const char *key) {
+    // returns true if key was not in the tree
+    bool put(const char *key) {
+        const unsigned char *k = (const unsigned char *)key;
+        if (!*k) {
+            return false;
+        }
 
-        if (!contains(key)) {
-            mSize++;
+        uint32_t spare = 0;
+        uint32_t n = mRoot.load(memory_order_acquire);
+        if (!n) {
+            n = link(mRoot, *k, spare);
         }
 
-        mRoot = put(mRoot, key, (int)strlen(key));
-    }
+        while (true) {
+            Node &current = node(n);
+            atomic<uint32_t> *slot;
+
+            if (*k < current.c) {
+                slot = &current.left;
+            } else if (*k > current.c) {
+                slot = &current.right;
+            } else if (k[1]) {
+                slot = &current.mid;
+                k++;
+            } else {
+                if (current.set.exchange(true, memory_order_acq_rel)) {
+                    // unused spare stays allocated, nodes are never freed
+                    return false;
+                }
+                mSize.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
 
+            n = slot->load(memory_order_acquire);
+            if (!n) {
+                n = link(*slot, *k, spare);
+            }
+        }
+    }
 };
 
+// lookups/sec of single and batched lookups, half of the queried keys are present
+void benchmark(int keys, int lookups)
+{
+    mt19937 rnd(42);
+    vector<string> words(keys * 2);
+    for (string &word : words) {
+        int len = 4 + rnd() % 12;
+        for (int i = 0; i < len; i++) {
+            word.push_back('a' + rnd() % 26);
+        }
+    }
+
+    TST<> tst;
+    for (int i = 0; i < keys; i++) {
+        tst.put(words[i].c_str());
+    }
+    FrozenTST<bool> frozen = tst.freeze();
+
+    vector<const char *> queries(lookups);
+    for (const char *&query : queries) {
+        query = words[rnd() % words.size()].c_str();
+    }
+
+    cout << "keys " << tst.size() << ", nodes " << tst.nodes() << ", frozen nodes " << frozen.nodes() << ", frozen bytes " << frozen.bytes() << endl;
+
+    auto report = [&](const char *name, chrono::steady_clock::time_point start, const vector<uint8_t> &found, int threads) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        long long hits = 0;
+        for (uint8_t f : found) {
+            hits += f;
+        }
+        cout << name << ", " << threads << " threads:\t" << (long long)(lookups / seconds) << " lookups/s, "
+             << (long long)(lookups / seconds / threads) << " per thread, hits " << hits << endl;
+        return hits;
+    };
+
+    vector<uint8_t> found(lookups);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        found[i] = tst.contains(queries[i]);
+    }
+    long long hits = report("TST contains", start, found, 1);
+
+    start = chrono::steady_clock::now();
+    tst.containsMany(queries, found);
+    assert(report("TST containsMany", start, found, 1) == hits);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        found[i] = frozen.contains(queries[i]);
+    }
+    assert(report("FrozenTST contains", start, found, 1) == hits);
+
+    for (int threads = 1; threads <= (int)thread::hardware_concurrency() * 2; threads *= 2) {
+        start = chrono::steady_clock::now();
+        frozen.containsMany(queries, found, threads);
+        assert(report("FrozenTST containsMany", start, found, threads) == hits);
+    }
+}
+
+// mixed workload: writers insert the second half of keys while readers query
+// all keys, first half was inserted before; ConcurrentTST against TST behind a mutex
+void benchmarkConcurrent(int keys, int lookups, int threads)
+{
+    mt19937 rnd(7);
+    vector<string> words(keys);
+    for (string &word : words) {
+        int len = 4 + rnd() % 12;
+        for (int i = 0; i < len; i++) {
+            word.push_back('a' + rnd() % 26);
+        }
+    }
+
+    int writers = max(1, threads / 2);
+    int readers = max(1, threads - writers);
+
+    auto run = [&](const char *name, function<void(const char *)> put, function<bool(const char *)> contains) {
+        for (int i = 0; i < keys / 2; i++) {
+            put(words[i].c_str());
+        }
+
+        atomic<long long> hits(0);
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (int w = 0; w < writers; w++) {
+            workers.emplace_back([&, w]() {
+                for (int i = keys / 2 + w; i < keys; i += writers) {
+                    put(words[i].c_str());
+                }
+            });
+        }
+        for (int r = 0; r < readers; r++) {
+            workers.emplace_back([&, r]() {
+                mt19937 local(r);
+                long long found = 0;
+                for (int i = 0; i < lookups / readers; i++) {
+                    int k = local() % keys;
+                    bool present = contains(words[k].c_str());
+                    // keys inserted before the start are always visible
+                    assert(present || k >= keys / 2);
+                    found += present;
+                }
+                hits += found;
+            });
+        }
+        for (thread &worker : workers) {
+            worker.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        for (const string &word : words) {
+            assert(contains(word.c_str()));
+        }
+        cout << name << ", " << writers << " writers, " << readers << " readers:\t"
+             << (long long)((keys - keys / 2 + lookups) / seconds) << " ops/s, hits " << hits << endl;
+    };
+
+    ConcurrentTST concurrent;
+    run("ConcurrentTST",
+        [&](const char *key) { concurrent.put(key); },
+        [&](const char *key) { return concurrent.contains(key); });
+
+    TST<> tst;
+    mutex lock;
+    run("TST with mutex",
+        [&](const char *key) { lock_guard<mutex> guard(lock); tst.put(key); },
+        [&](const char *key) { lock_guard<mutex> guard(lock); return tst.contains(key); });
+    assert(concurrent.size() == tst.size());
+}
+
 int main()
 {
     cout << "Hello World!" << endl;
 
-    TST tst;
+    TST<> tst;
 
     tst.put("");
     tst.put("abra");
@@ -118,6 +1183,195 @@ int main()
     assert(!tst.contains("abrac"));
     assert(!tst.contains("abramart"));
 
+    assert(tst.size() == 3);
+    tst.put("abra");
+    assert(tst.size() == 3);
+
+    // deep tree: recursive destructor used to overflow the stack here
+    string deep(1000000, 'a');
+    tst.put(deep.c_str());
+    assert(tst.contains(deep.c_str()));
+    assert(tst.size() == 4);
+
+    tst.clear();
+    assert(tst.size() == 0);
+    assert(!tst.contains("abra"));
+
+    TST<int> map;
+    const char *keys[] = {"she", "sells", "sea", "shells", "by", "the", "sea", "shore"};
+    for (int i = 0; i < 8; i++) {
+        map.put(keys[i], i);
+    }
+    assert(map.size() == 7);
+    assert(*map.get("sea") == 6);
+    assert(!map.get("se"));
+
+    vector<string> found;
+    for (const string &key : map.keysWithPrefix("sh")) {
+        found.push_back(key);
+    }
+    assert(found == vector<string>({"she", "shells", "shore"}));
+
+    found.clear();
+    for (auto it = map.keysWithPrefix("").begin(); it != map.keysWithPrefix("").end(); ++it) {
+        found.push_back(it.key());
+        assert(*map.get(it.key().c_str()) == it.value());
+    }
+    assert(found == vector<string>({"by", "sea", "sells", "she", "shells", "shore", "the"}));
+
+    found.clear();
+    for (const string &key : map.keysWithPrefix("she")) {
+        found.push_back(key);
+    }
+    assert(found == vector<string>({"she", "shells"}));
+    assert(map.keysWithPrefix("x").begin() == map.keysWithPrefix("x").end());
+
+    assert(map.longestPrefixOf("shellsort") == "shells");
+    assert(map.longestPrefixOf("shell") == "she");
+    assert(map.longestPrefixOf("quicksort") == "");
+
+    assert(map.keysThatMatch(".he") == vector<string>({"she", "the"}));
+    assert(map.keysThatMatch("s..") == vector<string>({"sea", "she"}));
+    assert(map.keysThatMatch("s....") == vector<string>({"sells", "shore"}));
+
+    assert(map.remove("she"));
+    assert(!map.remove("she"));
+    assert(!map.contains("she"));
+    assert(map.contains("shells"));
+    assert(map.size() == 6);
+    assert(map.longestPrefixOf("shell") == "");
+    map.put("she", 10);
+    assert(*map.get("she") == 10);
+
+    // removed keys are dropped from the frozen copy
+    map.remove("by");
+    FrozenTST<int> frozen = map.freeze();
+    assert(frozen.size() == map.size());
+    assert(frozen.nodes() < map.nodes());
+    for (const char *key : {"she", "sells", "sea", "shells", "the", "shore"}) {
+        assert(frozen.contains(key));
+        assert(*frozen.get(key) == *map.get(key));
+    }
+    for (const char *key : {"", "by", "s", "sh", "shell", "shellsx", "t", "th", "z"}) {
+        assert(!frozen.contains(key));
+    }
+
+    // snapshot goes to a fresh file under /tmp, unlinked when main returns
+    char path[] = "/tmp/frozenTST.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    struct Unlink {
+        const char *path;
+        ~Unlink() { unlink(path); }
+    } unlinkSnapshot = {path};
+    assert(frozen.save(path));
+    FrozenTST<int> loaded;
+    assert(loaded.open(path));
+    assert(loaded.mapped() && loaded.bytes() == frozen.bytes());
+    assert(*loaded.get("shells") == 3);
+    assert(!loaded.contains("shell"));
+
+    // truncated or corrupted snapshots are rejected
+    string image(loaded.bytes(), 0);
+    FILE *file = fopen(path, "rb");
+    assert(fread(&image[0], 1, image.size(), file) == image.size());
+    fclose(file);
+    auto reopen = [path](const string &bytes) {
+        FILE *file = fopen(path, "wb");
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+        FrozenTST<int> tree;
+        return tree.open(path);
+    };
+    auto patched = [&image](size_t offset, uint32_t value) {
+        string copy = image;
+        memcpy(&copy[offset], &value, sizeof(value));
+        return copy;
+    };
+    typedef FrozenTST<int>::Node FrozenNode;
+    size_t root = 32 + sizeof(FrozenNode);     // after 32 byte header and null node
+    assert(reopen(image));
+    assert(!reopen(image.substr(0, image.size() - 1)));
+    assert(!reopen(image.substr(0, 16)));
+    assert(!reopen(patched(8, 1000)));      // size
+    assert(!reopen(patched(12, 1000)));     // nodes
+    assert(!reopen(patched(root + offsetof(FrozenNode, left), 1000)));
+    assert(!reopen(patched(root + offsetof(FrozenNode, mid), 1)));
+    assert(!reopen(patched(root + offsetof(FrozenNode, label), UINT32_MAX - 1)));
+    assert(!reopen(patched(root + offsetof(FrozenNode, length), 0)));
+    assert(!reopen(patched(root + offsetof(FrozenNode, value), 1000)));
+    remove(path);
+    assert(!loaded.open(path));
+
+    // single chain compresses to one node
+    TST<> chain;
+    chain.put(deep.c_str());
+    FrozenTST<bool> frozenChain = chain.freeze();
+    assert(frozenChain.nodes() == 1);
+    assert(frozenChain.contains(deep.c_str()));
+    assert(!frozenChain.contains(deep.substr(1).c_str()));
+    assert(!TST<>().freeze().contains("a"));
+
+    vector<const char *> queries = {"she", "", "shell", "shells", "by", "the", "shellsort", "sea"};
+    vector<uint8_t> present;
+    vector<uint8_t> expected = {1, 0, 0, 1, 1, 1, 0, 1};
+    map.put("by", 0);
+    map.containsMany(queries, present);
+    assert(present == expected);
+    expected[4] = 0;
+    frozen.containsMany(queries, present, 4);
+    assert(present == expected);
+
+    // enough keys for every one of 4 workers, half of them hits
+    TST<> evens;
+    vector<string> numbers;
+    for (int i = 0; i < 4 * 4096; i++) {
+        numbers.push_back(to_string(i * 7919 % 16384));
+        if (i % 2 == 0) {
+            evens.put(to_string(i).c_str());
+        }
+    }
+    FrozenTST<bool> frozenEvens = evens.freeze();
+    vector<const char *> many;
+    for (const string &number : numbers) {
+        many.push_back(number.c_str());
+    }
+    frozenEvens.containsMany(many, present, 4);
+    assert(present.size() == many.size());
+    int hits = 0;
+    for (size_t i = 0; i < many.size(); i++) {
+        assert(present[i] == frozenEvens.contains(many[i]));
+        hits += present[i];
+    }
+    assert(hits == 8192);
+
+    // racing writers insert overlapping keys, each key is counted once
+    ConcurrentTST concurrent;
+    vector<string> words;
+    for (int i = 0; i < 20000; i++) {
+        words.push_back(to_string(i * 7919 % 20000));
+    }
+    vector<thread> writers;
+    atomic<int> added(0);
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; i < (int)words.size(); i++) {
+                added += concurrent.put(words[(i + t * 5000) % words.size()].c_str());
+            }
+        });
+    }
+    for (thread &writer : writers) {
+        writer.join();
+    }
+    assert(added == 20000 && concurrent.size() == 20000);
+    for (const string &word : words) {
+        assert(concurrent.contains(word.c_str()));
+    }
+    assert(!concurrent.contains("20000") && !concurrent.contains("") && !concurrent.contains("1x"));
+
+    benchmark(1000000, 4000000);
+    benchmarkConcurrent(1000000, 4000000, max(2, (int)thread::hardware_concurrency()));
 
     return 0;
 }
@@ -4,259 +4,1387 @@
 #include <iostream>
 #include <vector>
 #include <cassert>
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <numeric>
 #include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 namespace std {
 
-class TreapTester;
-
+// How Treap::insert(key) picks priorities: RANDOM draws them from the
+// treap's own generator, KEY_HASH mixes hash of the key with the seed, so
+// the same keys give the same shape whatever the insertion order.
+enum class TreapPriorities {RANDOM, KEY_HASH};
+
+// Nodes live in a pool and link to each other by 32-bit indices, node 0 is
+// null with size 0. Removed nodes go to a free list and are reused.
+// split, merge, insert and remove are iterative, so neither allocations
+// nor recursion depth depend on the shape of the tree. Children are indexed
+// by comparison result, which keeps descents free of unpredictable branches.
+// Every node holds a count of equal keys. With countDuplicates insert adds
+// to the count of an existing node, otherwise every key gets its own node.
 template <typename KeyType, typename PriorityType>
 class Treap {
-    friend class TreapTester;
-
     struct Node {
         KeyType key;
         PriorityType priority;
 
-        unique_ptr<Node> left;
-        unique_ptr<Node> right;
-        size_t size = 1;
+        uint32_t child[2] = {0, 0};     // left, right
+        uint32_t count = 0;
+        uint32_t size = 0;              // sum of counts in subtree
+    };
+
+    vector<Node> mNodes = vector<Node>(1);
+    vector<uint32_t> mFree;
+    vector<uint32_t> mPath;     // scratch for bottom-up size updates
+    uint32_t mRoot = 0;
+
+    bool mCountDuplicates = false;
+    TreapPriorities mPriorities = TreapPriorities::RANDOM;
+    uint64_t mSeed = 0x853c49e6748fea9bULL;
+
+    static uint64_t splitmix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // 31 random bits, fit any integer or floating priority type
+    PriorityType nextPriority(const KeyType &k) {
+        uint64_t x;
+        if (mPriorities == TreapPriorities::KEY_HASH) {
+            x = splitmix(hash<KeyType>()(k) ^ mSeed);
+        } else {
+            mSeed += 0x9e3779b97f4a7c15ULL;
+            x = splitmix(mSeed);
+        }
+        return PriorityType(x >> 33);
+    }
+
+    uint32_t make(const KeyType &k, const PriorityType &p) {
+        uint32_t n;
+        if (!mFree.empty()) {
+            n = mFree.back();
+            mFree.pop_back();
+        } else {
+            assert(mNodes.size() < UINT32_MAX);
+            n = mNodes.size();
+            mNodes.push_back(Node());
+        }
+
+        Node &node = mNodes[n];
+        node.key = k;
+        node.priority = p;
+        node.child[0] = 0;
+        node.child[1] = 0;
+        node.count = 1;
+        node.size = 1;
+        return n;
+    }
+
+    void recalc(uint32_t n) {
+        Node &node = mNodes[n];
+        node.size = node.count + mNodes[node.child[0]].size + mNodes[node.child[1]].size;
+    }
 
-        Node(KeyType k, PriorityType p) : key(k), priority(p) {
+    void recalcPath() {
+        for (int i = (int)mPath.size() - 1; i >= 0; i--) {
+            recalc(mPath[i]);
         }
+    }
 
-        static size_t getSize(const unique_ptr<Node> &n) {
-            return n ? n->size : 0;
+    // left gets keys <= key (or < key if strict), right gets the rest.
+    // left and right may refer to links inside the pool, nothing is allocated here.
+    void split(uint32_t tree, const KeyType &key, uint32_t &left, uint32_t &right, bool strict = false) {
+        uint32_t *parts[2] = {&left, &right};
+        mPath.clear();
+
+        while (tree) {
+            mPath.push_back(tree);
+            Node &node = mNodes[tree];
+            int side = strict ? !(node.key < key) : key < node.key;
+
+            // node goes to its side with the subtree on the other side still to split
+            *parts[side] = tree;
+            parts[side] = &node.child[!side];
+            tree = node.child[!side];
         }
 
-        void recalc() {
-            assert(this);
-            size = 1 + getSize(left) + getSize(right);
+        *parts[0] = 0;
+        *parts[1] = 0;
+        recalcPath();
+    }
+
+    // all keys of left have to be <= keys of right
+    uint32_t merge(uint32_t left, uint32_t right) {
+        uint32_t tree = 0;
+        uint32_t *slot = &tree;
+        uint32_t parts[2] = {left, right};
+        mPath.clear();
+
+        while (parts[0] && parts[1]) {
+            assert(!(mNodes[parts[1]].key < mNodes[parts[0]].key));
+            int side = !(mNodes[parts[0]].priority > mNodes[parts[1]].priority);
+            uint32_t top = parts[side];
+
+            // rest of top's part continues on its inner side
+            *slot = top;
+            mPath.push_back(top);
+            slot = &mNodes[top].child[!side];
+            parts[side] = *slot;
         }
 
-        static void split(unique_ptr<Node> tree, KeyType key, unique_ptr<Node> &left, unique_ptr<Node> &right) {
-            if (!tree) {
-                left = nullptr;
-                right = nullptr;
-            } else if (key < tree->key) {
-                split(move(tree->left), key, left, tree->left);
-                assert(tree);
-                right = move(tree);
-                right->recalc();
-                assert(left != right);
-            } else {
-                split(move(tree->right), key, tree->right, right);
-                assert(tree);
-                left = move(tree);
-                left->recalc();
-                assert(left != right);
-            }
-        }
-
-        static void splitRight(unique_ptr<Node> tree, KeyType key, unique_ptr<Node> &left, unique_ptr<Node> &right) {
-            if (!tree) {
-                left = nullptr;
-                right = nullptr;
-            } else if (key <= tree->key) {
-                splitRight(move(tree->left), key, left, tree->left);
-                assert(tree);
-                right = move(tree);
-                right->recalc();
-                assert(left != right);
-            } else {
-                splitRight(move(tree->right), key, tree->right, right);
-                assert(tree);
-                left = move(tree);
-                left->recalc();
-                assert(left != right);
-            }
+        *slot = parts[0] ? parts[0] : parts[1];
+        recalcPath();
+        return tree;
+    }
+
+    // returns nodes of subtree to free list
+    void release(uint32_t tree) {
+        if (!tree) {
+            return;
         }
 
-        static void insert(unique_ptr<Node> &tree, unique_ptr<Node> &item) {
-            if (!tree) {
-                tree = move(item);
-            } else if (item->priority > tree->priority) {
-                split(move(tree), item->key, item->left, item->right);
-                tree = move(item);
-            } else {
-                insert(item->key <= tree->key ? tree->left : tree->right, item);
+        size_t from = mFree.size();
+        mFree.push_back(tree);
+        for (size_t i = from; i < mFree.size(); i++) {
+            const Node &node = mNodes[mFree[i]];
+            for (uint32_t c : node.child) {
+                if (c) {
+                    mFree.push_back(c);
+                }
             }
+        }
+    }
 
-            tree->recalc();
+    // splits tree into keys < key, == key and > key
+    void split3(uint32_t tree, const KeyType &key, uint32_t &less, uint32_t &equal, uint32_t &greater) {
+        uint32_t notGreater;
+        split(tree, key, notGreater, greater);
+        split(notGreater, key, less, equal, true);
+    }
+
+    enum SetOperation {UNION, INTERSECTION, DIFFERENCE};
+
+    // Both trees are in this pool, nodes of b that don't make it to the result
+    // are released. Higher priority root is the pivot, both trees are split
+    // by its key and the halves combined recursively, O(m log(n/m + 1)).
+    // Keys equal to pivot are kept from a, or from both for UNION.
+    // Recursion depth is bounded by tree heights.
+    uint32_t combine(uint32_t a, uint32_t b, SetOperation op) {
+        if (!a || !b) {
+            if (op == UNION) {
+                return a ? a : b;
+            }
+            release(b);
+            if (op == INTERSECTION) {
+                release(a);
+                return 0;
+            }
+            return a;
         }
 
-        static void merge(unique_ptr<Node> &tree, unique_ptr<Node> left, unique_ptr<Node> right) {
-            if (!left) {
-                tree = move(right);
-            } else if (!right) {
-                tree = move(left);
-            } else if (left->priority > right->priority) {
-                assert(left->key <= right->key);
-                merge(left->right, move(left->right), move(right));
-                tree = move(left);
-                assert(tree);
-                tree->recalc();
-            } else {
-                assert(left->key <= right->key);
-                merge(right->left, move(left), move(right->left));
-                tree = move(right);
-                assert(tree);
-                tree->recalc();
+        KeyType key = mNodes[a].priority > mNodes[b].priority ? mNodes[a].key : mNodes[b].key;
+        uint32_t aLess, aEqual, aGreater;
+        uint32_t bLess, bEqual, bGreater;
+        split3(a, key, aLess, aEqual, aGreater);
+        split3(b, key, bLess, bEqual, bGreater);
+
+        uint32_t less = combine(aLess, bLess, op);
+        uint32_t greater = combine(aGreater, bGreater, op);
+
+        uint32_t equal = aEqual;
+        if (op == UNION && mCountDuplicates && aEqual && bEqual) {
+            // one node for both groups of equal keys
+            uint32_t total = mNodes[aEqual].size + mNodes[bEqual].size;
+            for (uint32_t &c : mNodes[aEqual].child) {
+                release(c);
+                c = 0;
+            }
+            release(bEqual);
+            mNodes[aEqual].count = total;
+            mNodes[aEqual].size = total;
+        } else if (op == UNION) {
+            equal = merge(aEqual, bEqual);
+        } else {
+            if ((op == INTERSECTION) != (bEqual != 0)) {
+                release(aEqual);
+                equal = 0;
             }
+            release(bEqual);
         }
 
-        static unique_ptr<Node> remove(unique_ptr<Node> &tree, KeyType key) {
-            if (!tree) {
-                return nullptr;
+        return merge(merge(less, equal), greater);
+    }
+
+    // copies subtree of another pool into this one keeping its shape, returns new root
+    uint32_t copy(const Treap &from, uint32_t tree) {
+        if (!tree) {
+            return 0;
+        }
+
+        vector<pair<uint32_t, uint32_t>> stack;
+        uint32_t root = make(from.mNodes[tree].key, from.mNodes[tree].priority);
+        stack.push_back(make_pair(tree, root));
+        while (!stack.empty()) {
+            uint32_t source = stack.back().first;
+            uint32_t target = stack.back().second;
+            stack.pop_back();
+
+            mNodes[target].count = from.mNodes[source].count;
+            mNodes[target].size = from.mNodes[source].size;
+            for (int side = 0; side < 2; side++) {
+                uint32_t c = from.mNodes[source].child[side];
+                if (c) {
+                    uint32_t n = make(from.mNodes[c].key, from.mNodes[c].priority);
+                    mNodes[target].child[side] = n;
+                    stack.push_back(make_pair(c, n));
+                }
             }
+        }
+        return root;
+    }
+
+    // exchanges contents, settings stay
+    void swap(Treap &other) {
+        mNodes.swap(other.mNodes);
+        mFree.swap(other.mFree);
+        std::swap(mRoot, other.mRoot);
+    }
 
-            if (tree->key == key) {
-                auto removedNode = move(tree);
-                merge(tree, move(removedNode->left), move(removedNode->right));
-                return removedNode;
+    // moves tree of other into this pool and returns its root, mRoot stays this
+    // tree. The smaller of the two trees is copied, so this is O(min(n, m)).
+    uint32_t adopt(Treap &other) {
+        if (other.size() <= size()) {
+            uint32_t root = copy(other, other.mRoot);
+            other.clear();
+            return root;
+        }
+
+        swap(other);
+        uint32_t root = copy(other, other.mRoot);
+        other.clear();
+        std::swap(root, mRoot);
+        return root;
+    }
+
+    // Cartesian tree build: right spine is kept on a stack, node n with the
+    // largest key so far pops lower priorities and takes them as its left subtree
+    void pushSpine(vector<uint32_t> &spine, uint32_t n) {
+        assert(spine.empty() || !(mNodes[n].key < mNodes[spine.back()].key));
+
+        uint32_t left = 0;
+        while (!spine.empty() && mNodes[spine.back()].priority < mNodes[n].priority) {
+            left = spine.back();
+            spine.pop_back();
+        }
+        mNodes[n].child[0] = left;
+        if (!spine.empty()) {
+            mNodes[spine.back()].child[1] = n;
+        }
+        spine.push_back(n);
+    }
+
+    void finishSpine(const vector<uint32_t> &spine) {
+        if (spine.empty()) {
+            return;
+        }
+        mRoot = spine[0];
+
+        // sizes bottom-up: preorder lists parents before children
+        mPath.clear();
+        mPath.push_back(mRoot);
+        for (size_t i = 0; i < mPath.size(); i++) {
+            for (uint32_t c : mNodes[mPath[i]].child) {
+                if (c) {
+                    mPath.push_back(c);
+                }
             }
+        }
+        recalcPath();
+    }
+
+public:
 
-            auto result = remove(key < tree->key ? tree->left : tree->right, key);
-            if (tree) {
-                tree->recalc();
+    void insert(KeyType k, PriorityType p) {
+        if (mCountDuplicates) {
+            uint32_t n = mRoot;
+            mPath.clear();
+            while (n && !(mNodes[n].key == k)) {
+                mPath.push_back(n);
+                n = mNodes[n].child[!(k < mNodes[n].key)];
             }
-            return result;
+            if (n) {
+                for (uint32_t m : mPath) {
+                    mNodes[m].size++;
+                }
+                mNodes[n].count++;
+                mNodes[n].size++;
+                return;
+            }
+        }
+
+        uint32_t item = make(k, p);
+
+        // sizes grow on the way down, item ends up below every visited node
+        uint32_t *slot = &mRoot;
+        while (*slot && !(p > mNodes[*slot].priority)) {
+            Node &node = mNodes[*slot];
+            node.size++;
+            slot = &node.child[node.key < k];
+        }
+
+        split(*slot, k, mNodes[item].child[0], mNodes[item].child[1]);
+        recalc(item);
+        *slot = item;
+    }
+
+    // priority from the treap's generator
+    void insert(KeyType k) {
+        insert(k, nextPriority(k));
+    }
+
+    // removes one occurrence of key
+    bool remove(KeyType key) {
+        uint32_t *slot = &mRoot;
+        mPath.clear();
+        while (*slot && !(mNodes[*slot].key == key)) {
+            Node &node = mNodes[*slot];
+            mPath.push_back(*slot);
+            slot = &node.child[!(key < node.key)];
+        }
+        if (!*slot) {
+            return false;
+        }
+
+        for (uint32_t n : mPath) {
+            mNodes[n].size--;
+        }
+
+        uint32_t n = *slot;
+        if (mNodes[n].count > 1) {
+            mNodes[n].count--;
+            mNodes[n].size--;
+            return true;
+        }
+        *slot = merge(mNodes[n].child[0], mNodes[n].child[1]);
+        mFree.push_back(n);
+        return true;
+    }
+
+    Treap() {}
+
+    explicit Treap(bool countDuplicates, TreapPriorities priorities = TreapPriorities::RANDOM, uint64_t seed = 1)
+        : mCountDuplicates(countDuplicates), mPriorities(priorities), mSeed(seed) {
+    }
+
+    Treap(const Treap &) = default;
+    Treap &operator=(const Treap &) = default;
+
+    // moved-from treap is left empty
+    Treap(Treap &&other)
+        : mCountDuplicates(other.mCountDuplicates), mPriorities(other.mPriorities), mSeed(other.mSeed) {
+        swap(other);
+    }
+
+    Treap &operator=(Treap &&other) {
+        if (this != &other) {
+            swap(other);
+            other.clear();
+            mCountDuplicates = other.mCountDuplicates;
+            mPriorities = other.mPriorities;
+            mSeed = other.mSeed;
+        }
+        return *this;
+    }
+
+    // O(n) build from (key, priority) pairs sorted by key, default settings
+    template <typename Iterator>
+    Treap(Iterator first, Iterator last) {
+        vector<uint32_t> spine;
+        for (; first != last; ++first) {
+            pushSpine(spine, make(first->first, first->second));
         }
+        finishSpine(spine);
+    }
 
-        static unique_ptr<Node> removeRange(unique_ptr<Node> &tree, KeyType key) {
-            if (!tree) {
-                return nullptr;
+    // O(n) build from sorted keys, priorities are drawn as insert() does.
+    // With countDuplicates a run of equal keys becomes one node
+    template <typename Iterator>
+    Treap(Iterator first, Iterator last, bool countDuplicates,
+          TreapPriorities priorities = TreapPriorities::RANDOM, uint64_t seed = 1)
+        : Treap(countDuplicates, priorities, seed) {
+        vector<uint32_t> spine;
+        for (; first != last; ++first) {
+            const KeyType &k = *first;
+            if (mCountDuplicates && !spine.empty() && mNodes[spine.back()].key == k) {
+                mNodes[spine.back()].count++;
+                continue;
             }
+            pushSpine(spine, make(k, nextPriority(k)));
+        }
+        finishSpine(spine);
+    }
+
+    // keeps keys <= key (< key if strict) and returns the rest, O(log n) plus
+    // copying the smaller part into its own pool
+    Treap split(const KeyType &key, bool strict = false) {
+        uint32_t l, r;
+        split(mRoot, key, l, r, strict);
+
+        Treap result(mCountDuplicates, mPriorities, mSeed);
+        bool leftSmaller = mNodes[l].size < mNodes[r].size;
+        uint32_t smaller = leftSmaller ? l : r;
+        result.mRoot = result.copy(*this, smaller);
+        release(smaller);
+        mRoot = leftSmaller ? r : l;
+        if (leftSmaller) {
+            swap(result);
+        }
+        return result;
+    }
+
+    // Set operations consume other, pass a copy to keep it.
+
+    // appends other, all its keys have to be >= keys of this treap
+    void join(Treap &&other) {
+        uint32_t root = adopt(other);
+        mRoot = merge(mRoot, root);
+    }
+
+    // adds all keys of other
+    void unite(Treap &&other) {
+        uint32_t root = adopt(other);
+        mRoot = combine(mRoot, root, UNION);
+    }
+
+    // keeps only keys also present in other
+    void intersect(Treap &&other) {
+        uint32_t root = adopt(other);
+        mRoot = combine(mRoot, root, INTERSECTION);
+    }
+
+    // removes keys present in other
+    void subtract(Treap &&other) {
+        uint32_t root = adopt(other);
+        mRoot = combine(mRoot, root, DIFFERENCE);
+    }
 
-            unique_ptr<Node> l;
-            unique_ptr<Node> r;
-            unique_ptr<Node> m;
+    void clear() {
+        mNodes.resize(1);
+        mFree.clear();
+        mRoot = 0;
+    }
+
+    // allocated nodes, including free ones
+    size_t nodes() const {
+        return mNodes.size() - 1;
+    }
+
+    // removes all occurrences of key
+    bool removeRange(KeyType key) {
+        uint32_t l, m, r;
+        split(mRoot, key, l, r);
+        split(l, key, l, m, true);
+        mRoot = merge(l, r);
 
-            split(move(tree), key, l, r);
-            splitRight(move(l), key, l, m);
+        release(m);
+        return m != 0;
+    }
 
-            merge(tree, move(l), move(r));
+    size_t size() const {
+        return mNodes[mRoot].size;
+    }
+
+    bool isEmpty() {
+        return mRoot == 0;
+    }
+
+    KeyType operator[](size_t i) const {
+        assert(i < size());
+        return node(i).key;
+    }
 
-            return m;
+    // Ordered bidirectional iterator over keys. Path from root is kept in a
+    // fixed array, so iteration doesn't allocate and ++/-- are amortized
+    // O(1). Trees deeper than MAX_DEPTH (only possible with adversarial
+    // priorities) fall back to finding the node by index. Any modification
+    // of the treap invalidates iterators.
+    class Iterator {
+        static const int MAX_DEPTH = 64;
+
+        const Treap *mTree = nullptr;
+        size_t mIndex = 0;
+        uint32_t mOffset = 0;   // occurrence of the key within its node
+        uint32_t mPath[MAX_DEPTH];
+        int mDepth = 0;         // 0 - past the end, -1 - path too deep, found by index
+
+        const Node &node(uint32_t n) const {
+            return mTree->mNodes[n];
         }
 
-        Node *getByIndex(size_t i) {
-            assert(i < size);
+        // path to mIndex-th node
+        void seek() {
+            mDepth = 0;
+            if (mIndex >= mTree->size()) {
+                return;
+            }
 
-            size_t leftSize = getSize(left);
+            size_t i = mIndex;
+            uint32_t n = mTree->mRoot;
+            while (true) {
+                if (mDepth == MAX_DEPTH) {
+                    mDepth = -1;
+                    return;
+                }
+                mPath[mDepth++] = n;
+
+                size_t leftSize = node(node(n).child[0]).size;
+                if (i < leftSize) {
+                    n = node(n).child[0];
+                } else if (i < leftSize + node(n).count) {
+                    mOffset = i - leftSize;
+                    return;
+                } else {
+                    i -= leftSize + node(n).count;
+                    n = node(n).child[1];
+                }
+            }
+        }
 
-            if (i < leftSize) {
-                return left->getByIndex(i);
+        // side 1 moves to successor, side 0 to predecessor
+        void step(int side) {
+            mIndex += side ? 1 : -1;
+            if (mDepth <= 0) {
+                seek();
+                return;
             }
 
-            if (i == leftSize) {
-                return this;
+            // next occurrence of the same key
+            if (side ? mOffset + 1 < node(mPath[mDepth - 1]).count : mOffset > 0) {
+                mOffset += side ? 1 : -1;
+                return;
+            }
+
+            uint32_t c = node(mPath[mDepth - 1]).child[side];
+            if (c) {
+                // next is the outermost node of that subtree
+                while (c) {
+                    if (mDepth == MAX_DEPTH) {
+                        seek();
+                        return;
+                    }
+                    mPath[mDepth++] = c;
+                    c = node(c).child[!side];
+                }
+            } else {
+                // climb while coming up from the same side
+                uint32_t from = mPath[--mDepth];
+                while (mDepth > 0 && node(mPath[mDepth - 1]).child[side] == from) {
+                    from = mPath[--mDepth];
+                }
+            }
+            if (mDepth > 0) {
+                mOffset = side ? 0 : node(mPath[mDepth - 1]).count - 1;
+            }
+        }
+
+    public:
+        typedef bidirectional_iterator_tag iterator_category;
+        typedef KeyType value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const KeyType *pointer;
+        typedef const KeyType &reference;
+
+        Iterator() {}
+
+        Iterator(const Treap *tree, size_t index) : mTree(tree), mIndex(index) {
+            seek();
+        }
+
+        // position of the key in sorted order
+        size_t index() const {
+            return mIndex;
+        }
+
+        const KeyType &operator*() const {
+            if (mDepth > 0) {
+                return node(mPath[mDepth - 1]).key;
             }
+            return mTree->node(mIndex).key;
+        }
+
+        const KeyType *operator->() const {
+            return &**this;
+        }
+
+        Iterator &operator++() {
+            step(1);
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            step(1);
+            return old;
+        }
+
+        Iterator &operator--() {
+            step(0);
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            Iterator old = *this;
+            step(0);
+            return old;
+        }
+
+        bool operator==(const Iterator &other) const {
+            return mIndex == other.mIndex;
+        }
 
-            assert(right);
-            return right->getByIndex(i - 1 - leftSize);
+        bool operator!=(const Iterator &other) const {
+            return mIndex != other.mIndex;
         }
+    };
+
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
 
-        void printFlat() {
-            if (left) {
-                left->printFlat();
+    Iterator end() const {
+        return Iterator(this, size());
+    }
+
+    // nodes on the search path to key, the root has depth 1; 0 if key is absent
+    size_t depth(const KeyType &key) const {
+        size_t d = 0;
+        for (uint32_t n = mRoot; n; n = mNodes[n].child[!(key < mNodes[n].key)]) {
+            d++;
+            if (mNodes[n].key == key) {
+                return d;
             }
+        }
+        return 0;
+    }
+
+    // number of keys < key
+    size_t rank(const KeyType &key) const {
+        return countBelow(mRoot, key, false);
+    }
+
+    size_t count(const KeyType &key) const {
+        return rangeCount(key, key);
+    }
+
+    // first key >= key
+    Iterator lower_bound(const KeyType &key) const {
+        return Iterator(this, rank(key));
+    }
 
-            cout << "(" << key << ":" << priority << ") ";
+    // first key > key
+    Iterator upper_bound(const KeyType &key) const {
+        return Iterator(this, countBelow(mRoot, key, true));
+    }
 
-            if (right) {
-                right->printFlat();
+    // number of keys in [lo, hi]: one descent while both bounds go the same
+    // way, then one more for each bound below the node where they part
+    size_t rangeCount(const KeyType &lo, const KeyType &hi) const {
+        uint32_t n = mRoot;
+        while (n) {
+            const Node &node = mNodes[n];
+            if (node.key < lo) {
+                n = node.child[1];
+            } else if (hi < node.key) {
+                n = node.child[0];
+            } else {
+                uint32_t left = node.child[0];
+                return node.count + mNodes[left].size - countBelow(left, lo, false) + countBelow(node.child[1], hi, true);
             }
         }
+        return 0;
+    }
 
-        void print(int offset = 0) {
-            cout << string(offset * 4, ' ');
-            cout << "(" << key << ":" << priority << ") - " << size << endl;
-            if (left) {
-                left->print(offset + 1);
+    // k-th smallest (from 0) of keys in [lo, hi]
+    KeyType kth(const KeyType &lo, const KeyType &hi, size_t k) const {
+        assert(k < rangeCount(lo, hi));
+        return (*this)[rank(lo) + k];
+    }
+
+private:
+    // i-th node in key order. Branches here, repeated queries like median
+    // follow the same path and predict well.
+    const Node &node(size_t i) const {
+        uint32_t n = mRoot;
+        while (true) {
+            const Node &node = mNodes[n];
+            size_t leftSize = mNodes[node.child[0]].size;
+
+            if (i < leftSize) {
+                n = node.child[0];
+            } else if (i < leftSize + node.count) {
+                return node;
             } else {
-                cout << string(offset * 4 + 4, ' ') << "null" << endl;
+                i -= leftSize + node.count;
+                n = node.child[1];
             }
-            if (right) {
-                right->print(offset + 1);
+        }
+    }
+
+    // keys of subtree < key, or <= key if inclusive
+    size_t countBelow(uint32_t tree, const KeyType &key, bool inclusive) const {
+        size_t result = 0;
+        while (tree) {
+            const Node &node = mNodes[tree];
+            if (inclusive ? !(key < node.key) : node.key < key) {
+                result += mNodes[node.child[0]].size + node.count;
+                tree = node.child[1];
             } else {
-                cout << string(offset * 4 + 4, ' ') << "null" << endl;
+                tree = node.child[0];
             }
         }
+        return result;
+    }
+};
+
+
+// Implicit treap (rope): sequence keyed by position, with O(log n) insert,
+// erase, split and concatenation. Monoid has the same interface as in
+// segmenttree.h (Value, identity, combine, repeat) and gives aggregates of
+// position ranges. Range add and range reverse are lazy tags pushed down on
+// the way. Reverse leaves aggregates as they are, so combine has to be
+// commutative when reverse is used. Ranges are half-open [from, to).
+// Same pooled, iterative layout as Treap, priorities come from a
+// per-instance xorshift generator.
+template <typename Monoid>
+class ImplicitTreap {
+public:
+    typedef typename Monoid::Value Value;
+
+private:
+    struct Node {
+        Value value;
+        Value sum;
+        Value add;
+
+        uint32_t priority = 0;
+        uint32_t child[2] = {0, 0};
+        uint32_t size = 0;
+        bool hasAdd = false;
+        bool reversed = false;      // children of this subtree still have to be swapped
     };
 
-    unique_ptr<Node> mpRoot;
+    vector<Node> mNodes = vector<Node>(1);
+    vector<uint32_t> mFree;
+    vector<uint32_t> mPath;
+    uint32_t mRoot = 0;
+    uint32_t mSeed = 2463534242u;
+
+    uint32_t nextPriority() {
+        mSeed ^= mSeed << 13;
+        mSeed ^= mSeed >> 17;
+        mSeed ^= mSeed << 5;
+        return mSeed;
+    }
+
+    uint32_t make(const Value &value) {
+        uint32_t n;
+        if (!mFree.empty()) {
+            n = mFree.back();
+            mFree.pop_back();
+        } else {
+            assert(mNodes.size() < UINT32_MAX);
+            n = mNodes.size();
+            mNodes.push_back(Node());
+        }
+
+        Node &node = mNodes[n];
+        node.value = value;
+        node.sum = value;
+        node.priority = nextPriority();
+        node.child[0] = 0;
+        node.child[1] = 0;
+        node.size = 1;
+        node.hasAdd = false;
+        node.reversed = false;
+        return n;
+    }
+
+    void apply(uint32_t n, const Value &add) {
+        Node &node = mNodes[n];
+        node.value = node.value + add;
+        node.sum = node.sum + Monoid::repeat(add, node.size);
+        node.add = node.hasAdd ? node.add + add : add;
+        node.hasAdd = true;
+    }
+
+    void push(uint32_t n) {
+        Node &node = mNodes[n];
+        if (node.reversed) {
+            std::swap(node.child[0], node.child[1]);
+            for (uint32_t c : node.child) {
+                if (c) {
+                    mNodes[c].reversed = !mNodes[c].reversed;
+                }
+            }
+            node.reversed = false;
+        }
+        if (node.hasAdd) {
+            for (uint32_t c : node.child) {
+                if (c) {
+                    apply(c, node.add);
+                }
+            }
+            node.hasAdd = false;
+        }
+    }
+
+    void pull(uint32_t n) {
+        Node &node = mNodes[n];
+        const Node &left = mNodes[node.child[0]];
+        const Node &right = mNodes[node.child[1]];
+        node.size = 1 + left.size + right.size;
+        node.sum = Monoid::combine(Monoid::combine(left.sum, node.value), right.sum);
+    }
+
+    void pullPath() {
+        for (int i = (int)mPath.size() - 1; i >= 0; i--) {
+            pull(mPath[i]);
+        }
+    }
+
+    // left gets first k elements of tree, right the rest
+    void splitAt(uint32_t tree, size_t k, uint32_t &left, uint32_t &right) {
+        uint32_t *parts[2] = {&left, &right};
+        mPath.clear();
+
+        while (tree) {
+            push(tree);
+            mPath.push_back(tree);
+            Node &node = mNodes[tree];
+            size_t leftSize = mNodes[node.child[0]].size;
+            int side = k <= leftSize;
+            if (!side) {
+                k -= leftSize + 1;
+            }
+
+            *parts[side] = tree;
+            parts[side] = &node.child[!side];
+            tree = node.child[!side];
+        }
+
+        *parts[0] = 0;
+        *parts[1] = 0;
+        pullPath();
+    }
+
+    uint32_t merge(uint32_t left, uint32_t right) {
+        uint32_t tree = 0;
+        uint32_t *slot = &tree;
+        uint32_t parts[2] = {left, right};
+        mPath.clear();
+
+        while (parts[0] && parts[1]) {
+            int side = !(mNodes[parts[0]].priority > mNodes[parts[1]].priority);
+            uint32_t top = parts[side];
+            push(top);
+
+            *slot = top;
+            mPath.push_back(top);
+            slot = &mNodes[top].child[!side];
+            parts[side] = *slot;
+        }
+
+        *slot = parts[0] ? parts[0] : parts[1];
+        pullPath();
+        return tree;
+    }
+
+    void release(uint32_t tree) {
+        if (!tree) {
+            return;
+        }
+
+        size_t from = mFree.size();
+        mFree.push_back(tree);
+        for (size_t i = from; i < mFree.size(); i++) {
+            for (uint32_t c : mNodes[mFree[i]].child) {
+                if (c) {
+                    mFree.push_back(c);
+                }
+            }
+        }
+    }
+
+    // copies subtree of another pool with its pending tags, returns new root
+    uint32_t copy(const ImplicitTreap &from, uint32_t tree) {
+        if (!tree) {
+            return 0;
+        }
+
+        vector<pair<uint32_t, uint32_t>> stack;
+        uint32_t root = make(Value());
+        stack.push_back(make_pair(tree, root));
+        while (!stack.empty()) {
+            uint32_t source = stack.back().first;
+            uint32_t target = stack.back().second;
+            stack.pop_back();
+
+            mNodes[target] = from.mNodes[source];
+            for (int side = 0; side < 2; side++) {
+                uint32_t c = from.mNodes[source].child[side];
+                if (c) {
+                    uint32_t n = make(Value());
+                    mNodes[target].child[side] = n;
+                    stack.push_back(make_pair(c, n));
+                }
+            }
+        }
+        return root;
+    }
+
+    void swap(ImplicitTreap &other) {
+        mNodes.swap(other.mNodes);
+        mFree.swap(other.mFree);
+        std::swap(mRoot, other.mRoot);
+        std::swap(mSeed, other.mSeed);
+    }
+
+    // runs f on the subtree holding [from, to)
+    template <typename F>
+    void onRange(size_t from, size_t to, F f) {
+        assert(from <= to && to <= size());
+        uint32_t left, middle, right;
+        splitAt(mRoot, from, left, middle);
+        splitAt(middle, to - from, middle, right);
+        f(middle);
+        mRoot = merge(merge(left, middle), right);
+    }
 
 public:
+    ImplicitTreap() {
+        mNodes[0].sum = Monoid::identity();
+    }
 
-    void insert(KeyType k, PriorityType p) {
-        auto i = unique_ptr<Node>(new Node(k, p));
-        Node::insert(mpRoot, i);
+    // O(n) build, right spine of the Cartesian tree is kept on a stack
+    template <typename Iterator>
+    ImplicitTreap(Iterator first, Iterator last) : ImplicitTreap() {
+        vector<uint32_t> spine;
+        for (; first != last; ++first) {
+            uint32_t n = make(*first);
+            uint32_t left = 0;
+            while (!spine.empty() && mNodes[spine.back()].priority < mNodes[n].priority) {
+                left = spine.back();
+                spine.pop_back();
+            }
+            mNodes[n].child[0] = left;
+            if (!spine.empty()) {
+                mNodes[spine.back()].child[1] = n;
+            }
+            spine.push_back(n);
+        }
+
+        if (spine.empty()) {
+            return;
+        }
+        mRoot = spine[0];
+
+        mPath.clear();
+        mPath.push_back(mRoot);
+        for (size_t i = 0; i < mPath.size(); i++) {
+            for (uint32_t c : mNodes[mPath[i]].child) {
+                if (c) {
+                    mPath.push_back(c);
+                }
+            }
+        }
+        pullPath();
     }
 
-    bool remove(KeyType key) {
-        return Node::remove(mpRoot, key).get();
+    ImplicitTreap(const ImplicitTreap &) = default;
+    ImplicitTreap &operator=(const ImplicitTreap &) = default;
+
+    ImplicitTreap(ImplicitTreap &&other) : ImplicitTreap() {
+        swap(other);
     }
 
-    bool removeRange(KeyType key) {
-        return Node::removeRange(mpRoot, key).get();
+    ImplicitTreap &operator=(ImplicitTreap &&other) {
+        if (this != &other) {
+            swap(other);
+            other.clear();
+        }
+        return *this;
     }
 
     size_t size() const {
-        return Node::getSize(mpRoot);
+        return mNodes[mRoot].size;
     }
 
-    bool isEmpty() {
-        return Node::getSize(mpRoot) == 0;
+    bool isEmpty() const {
+        return mRoot == 0;
     }
 
-    KeyType operator[](size_t i) const {
+    void clear() {
+        mNodes.resize(1);
+        mFree.clear();
+        mRoot = 0;
+    }
+
+    // element at position i, pending tags of ancestors are applied on the fly
+    Value operator[](size_t i) const {
         assert(i < size());
-        assert(mpRoot);
-        Node *n = mpRoot->getByIndex(i);
 
-        return n->key;
+        uint32_t n = mRoot;
+        bool reversed = false;
+        bool hasAdd = false;
+        Value add = Value();
+        while (true) {
+            const Node &node = mNodes[n];
+            reversed = reversed != node.reversed;
+            uint32_t left = node.child[reversed];
+            size_t leftSize = mNodes[left].size;
+
+            if (i == leftSize) {
+                return hasAdd ? node.value + add : node.value;
+            }
+            if (node.hasAdd) {
+                add = hasAdd ? add + node.add : node.add;
+                hasAdd = true;
+            }
+            if (i < leftSize) {
+                n = left;
+            } else {
+                i -= leftSize + 1;
+                n = node.child[!reversed];
+            }
+        }
+    }
+
+    void insert(size_t pos, const Value &value) {
+        assert(pos <= size());
+        uint32_t left, right;
+        splitAt(mRoot, pos, left, right);
+        mRoot = merge(merge(left, make(value)), right);
+    }
+
+    void pushBack(const Value &value) {
+        mRoot = merge(mRoot, make(value));
+    }
+
+    void erase(size_t pos) {
+        erase(pos, pos + 1);
+    }
+
+    void erase(size_t from, size_t to) {
+        onRange(from, to, [this](uint32_t &middle) {
+            release(middle);
+            middle = 0;
+        });
+    }
+
+    void reverse(size_t from, size_t to) {
+        onRange(from, to, [this](uint32_t &middle) {
+            if (middle) {
+                mNodes[middle].reversed = !mNodes[middle].reversed;
+            }
+        });
+    }
+
+    // adds value to every element of [from, to)
+    void add(size_t from, size_t to, const Value &value) {
+        onRange(from, to, [this, &value](uint32_t &middle) {
+            if (middle) {
+                apply(middle, value);
+            }
+        });
+    }
+
+    // aggregate of [from, to), identity for empty range
+    Value query(size_t from, size_t to) {
+        Value result = Monoid::identity();
+        onRange(from, to, [this, &result](uint32_t &middle) {
+            result = mNodes[middle].sum;
+        });
+        return result;
+    }
+
+    // keeps first pos elements and returns the rest, O(log n) plus copying
+    // the smaller part into its own pool
+    ImplicitTreap splitAt(size_t pos) {
+        assert(pos <= size());
+        uint32_t left, right;
+        splitAt(mRoot, pos, left, right);
+
+        ImplicitTreap result;
+        bool leftSmaller = mNodes[left].size < mNodes[right].size;
+        uint32_t smaller = leftSmaller ? left : right;
+        result.mRoot = result.copy(*this, smaller);
+        release(smaller);
+        mRoot = leftSmaller ? right : left;
+        if (leftSmaller) {
+            swap(result);
+        }
+        return result;
+    }
+
+    // appends other, the smaller of the two is copied into the other's pool
+    void concat(ImplicitTreap other) {
+        if (other.size() <= size()) {
+            uint32_t root = copy(other, other.mRoot);
+            mRoot = merge(mRoot, root);
+        } else {
+            uint32_t root = other.copy(*this, mRoot);
+            other.mRoot = other.merge(root, other.mRoot);
+            swap(other);
+        }
+        other.clear();
     }
 };
 
 
-class TreapTester {
+// Persistent treap: nodes are immutable and shared between versions by
+// reference counting. Every PersistentTreap object is one version, copying
+// it is an O(1) snapshot. insert and remove copy only the nodes on their
+// paths, O(log n) new nodes per update, and older versions stay valid.
+// Snapshots may be read from other threads while the writer goes on
+// updating its own version. The copy itself has to happen where the
+// writer can't modify the source at the same time.
+template <typename KeyType>
+class PersistentTreap {
+    struct Node;
+    typedef shared_ptr<const Node> Link;
 
-    template <typename KeyType, typename PriorityType>
-    static void printFlat(const Treap<KeyType, PriorityType> &t) {
-        if (t.mpRoot) {
-            t.mpRoot->printFlat();
-            cout << endl;
+    struct Node {
+        KeyType key;
+        uint32_t priority;
+        uint32_t size;
+        Link child[2];
+
+        Node(const KeyType &k, uint32_t p) : key(k), priority(p), size(1) {
+        }
+    };
+
+    Link mRoot;
+    uint64_t mSeed = 0x853c49e6748fea9bULL;
+
+    uint32_t nextPriority() {
+        uint64_t x = mSeed += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return (x ^ (x >> 31)) >> 32;
+    }
+
+    static uint32_t size(const Link &n) {
+        return n ? n->size : 0;
+    }
+
+    static void recalc(Node *n) {
+        n->size = 1 + size(n->child[0]) + size(n->child[1]);
+    }
+
+    // nodes copied on the way down get their sizes fixed bottom-up
+    static void recalc(vector<Node *> &path) {
+        for (int i = (int)path.size() - 1; i >= 0; i--) {
+            recalc(path[i]);
         }
     }
 
-    template <typename KeyType, typename PriorityType>
-    static void print(const Treap<KeyType, PriorityType> &t) {
-        cout << "================" << endl;
-        if (t.mpRoot) {
-            t.mpRoot->print();
+    // left gets keys <= key, right the rest; nodes on the path are copied
+    static void split(Link tree, const KeyType &key, Link &left, Link &right) {
+        Link *parts[2] = {&left, &right};
+        vector<Node *> path;
+
+        while (tree) {
+            shared_ptr<Node> copy = make_shared<Node>(*tree);
+            path.push_back(copy.get());
+            int side = key < copy->key;
+
+            tree = copy->child[!side];
+            *parts[side] = copy;
+            parts[side] = &copy->child[!side];
         }
-        cout << "================" << endl;
+
+        *parts[0] = nullptr;
+        *parts[1] = nullptr;
+        recalc(path);
     }
 
-    template <typename KeyType, typename PriorityType>
-    static void getKeys(const unique_ptr<typename Treap<KeyType, PriorityType>::Node> &n, vector<KeyType> &out) {
-        if (!n) {
-            return;
+    // all keys of left have to be <= keys of right; spine nodes are copied
+    static Link merge(Link left, Link right) {
+        Link tree;
+        Link *slot = &tree;
+        Link parts[2] = {left, right};
+        vector<Node *> path;
+
+        while (parts[0] && parts[1]) {
+            int side = !(parts[0]->priority > parts[1]->priority);
+            shared_ptr<Node> copy = make_shared<Node>(*parts[side]);
+            path.push_back(copy.get());
+
+            parts[side] = copy->child[!side];
+            *slot = copy;
+            slot = &copy->child[!side];
         }
 
-        getKeys<KeyType, PriorityType>(n->left, out);
+        *slot = parts[0] ? parts[0] : parts[1];
+        recalc(path);
+        return tree;
+    }
+
+public:
+    PersistentTreap() {}
+
+    explicit PersistentTreap(uint64_t seed) : mSeed(seed) {
+    }
+
+    // O(1), shares all nodes with this version
+    PersistentTreap snapshot() const {
+        return *this;
+    }
+
+    size_t size() const {
+        return size(mRoot);
+    }
+
+    bool isEmpty() const {
+        return !mRoot;
+    }
+
+    void clear() {
+        mRoot = nullptr;
+    }
+
+    void insert(const KeyType &k) {
+        uint32_t p = nextPriority();
+        shared_ptr<Node> item = make_shared<Node>(k, p);
+
+        // copies of nodes above the insertion point, each gains one key below
+        Link root;
+        Link *slot = &root;
+        Link tree = mRoot;
+        while (tree && !(p > tree->priority)) {
+            shared_ptr<Node> copy = make_shared<Node>(*tree);
+            copy->size++;
+            int side = copy->key < k;
+
+            tree = copy->child[side];
+            *slot = copy;
+            slot = &copy->child[side];
+        }
+
+        split(tree, k, item->child[0], item->child[1]);
+        recalc(item.get());
+        *slot = item;
+        mRoot = root;
+    }
+
+    // removes one occurrence of key
+    bool remove(const KeyType &key) {
+        if (!contains(key)) {
+            return false;
+        }
+
+        Link root;
+        Link *slot = &root;
+        Link tree = mRoot;
+        while (!(tree->key == key)) {
+            shared_ptr<Node> copy = make_shared<Node>(*tree);
+            copy->size--;
+            int side = !(key < copy->key);
+
+            tree = copy->child[side];
+            *slot = copy;
+            slot = &copy->child[side];
+        }
+
+        *slot = merge(tree->child[0], tree->child[1]);
+        mRoot = root;
+        return true;
+    }
+
+    bool contains(const KeyType &key) const {
+        const Node *n = mRoot.get();
+        while (n && !(n->key == key)) {
+            n = n->child[!(key < n->key)].get();
+        }
+        return n != nullptr;
+    }
+
+    // number of keys < key
+    size_t rank(const KeyType &key) const {
+        size_t result = 0;
+        const Node *n = mRoot.get();
+        while (n) {
+            if (n->key < key) {
+                result += size(n->child[0]) + 1;
+                n = n->child[1].get();
+            } else {
+                n = n->child[0].get();
+            }
+        }
+        return result;
+    }
 
-        out.push_back(n->key);
+    KeyType operator[](size_t i) const {
+        assert(i < size());
 
-        getKeys<KeyType, PriorityType>(n->right, out);
+        const Node *n = mRoot.get();
+        while (true) {
+            size_t leftSize = size(n->child[0]);
+            if (i < leftSize) {
+                n = n->child[0].get();
+            } else if (i == leftSize) {
+                return n->key;
+            } else {
+                i -= leftSize + 1;
+                n = n->child[1].get();
+            }
+        }
     }
 
+    // keys in order, iterative in-order walk
+    vector<KeyType> keys() const {
+        vector<KeyType> result;
+        vector<const Node *> stack;
+        const Node *n = mRoot.get();
+        while (n || !stack.empty()) {
+            while (n) {
+                stack.push_back(n);
+                n = n->child[0].get();
+            }
+            n = stack.back();
+            stack.pop_back();
+            result.push_back(n->key);
+            n = n->child[1].get();
+        }
+        return result;
+    }
+};
+
+
+class TreapTester {
+
     template <typename KeyType, typename PriorityType>
     static vector<KeyType> getKeys(const Treap<KeyType, PriorityType> &t) {
-        vector<KeyType> out;
-        getKeys<KeyType, PriorityType>(t.mpRoot, out);
-        return out;
+        return vector<KeyType>(t.begin(), t.end());
+    }
+
+    static Treap<int, int> random(int size, int range) {
+        Treap<int, int> t;
+        for (int i = 0; i < size; i++) {
+            t.insert(rand() % range);
+        }
+        return t;
     }
 
 public:
@@ -318,17 +1446,15 @@ public:
     }
 
     static void t2() {
-        srand(time(0));
-
         Treap<int, int> t;
 
-        t.insert(1, rand());
+        t.insert(1);
         assert(median(t) == 1);
 
-        t.insert(2, rand());
+        t.insert(2);
         assert(median(t) == 1.5);
 
-        t.insert(1, rand());
+        t.insert(1);
         assert(median(t) == 1);
 
         t.remove(1);
@@ -346,33 +1472,29 @@ public:
     static void t3() {
         Treap<int, int> t;
 
-        t.insert(1, rand());
-        t.insert(2, rand());
-        t.insert(3, rand());
-        t.insert(4, rand());
-        t.insert(5, rand());
-        t.insert(6, rand());
-        t.insert(7, rand());
-        t.insert(8, rand());
+        t.insert(1);
+        t.insert(2);
+        t.insert(3);
+        t.insert(4);
+        t.insert(5);
+        t.insert(6);
+        t.insert(7);
+        t.insert(8);
 
-        t.insert(3, rand());
-        t.insert(3, rand());
-        t.insert(3, rand());
-        t.insert(3, rand());
+        t.insert(3);
+        t.insert(3);
+        t.insert(3);
+        t.insert(3);
 
         assert(t.size() == 12);
 
-        unique_ptr<Treap<int, int>::Node> l;
-        unique_ptr<Treap<int, int>::Node> r;
-
-        Treap<int, int>::Node::split(move(t.mpRoot), 3, l, r);
+        Treap<int, int> r = t.split(3);
 
-        vector<int> lKeys;
-        getKeys<int, int>(l, lKeys);
+        vector<int> lKeys = getKeys(t);
         assert(lKeys == vector<int>({1, 2, 3, 3, 3, 3, 3}));
+        assert(t.size() == 7);
 
-        vector<int> rKeys;
-        getKeys<int, int>(r, rKeys);
+        vector<int> rKeys = getKeys(r);
         assert(rKeys == vector<int>({4, 5, 6, 7, 8}));
 
         cout << "t3 passed" << endl;
@@ -381,34 +1503,29 @@ public:
     static void t4() {
         Treap<int, int> t;
 
-        t.insert(1, rand());
-        t.insert(2, rand());
-        t.insert(3, rand());
-        t.insert(4, rand());
-        t.insert(5, rand());
-        t.insert(6, rand());
-        t.insert(7, rand());
-        t.insert(8, rand());
+        t.insert(1);
+        t.insert(2);
+        t.insert(3);
+        t.insert(4);
+        t.insert(5);
+        t.insert(6);
+        t.insert(7);
+        t.insert(8);
 
-        t.insert(3, rand());
-        t.insert(3, rand());
-        t.insert(3, rand());
-        t.insert(3, rand());
+        t.insert(3);
+        t.insert(3);
+        t.insert(3);
+        t.insert(3);
 
         assert(t.size() == 12);
 
-        unique_ptr<Treap<int, int>::Node> l;
-        unique_ptr<Treap<int, int>::Node> r;
+        Treap<int, int> r = t.split(3, true);
 
-        Treap<int, int>::Node::splitRight(move(t.mpRoot), 3, l, r);
-
-        vector<int> lKeys;
-        getKeys<int, int>(l, lKeys);
+        vector<int> lKeys = getKeys(t);
 
         assert(lKeys == vector<int>({1, 2}));
 
-        vector<int> rKeys;
-        getKeys<int, int>(r, rKeys);
+        vector<int> rKeys = getKeys(r);
         assert(rKeys == vector<int>({3, 3, 3, 3, 3, 4, 5, 6, 7, 8}));
 
         cout << "t4 passed" << endl;
@@ -417,18 +1534,18 @@ public:
     static void t5() {
         Treap<int, int> t;
 
-        t.insert(3, rand());
-        t.insert(4, rand());
-        t.insert(5, rand());
-        t.insert(1, rand());
-        t.insert(2, rand());
-        t.insert(6, rand());
-        t.insert(3, rand());
-        t.insert(3, rand());
-        t.insert(8, rand());
-        t.insert(7, rand());
-        t.insert(3, rand());
-        t.insert(3, rand());
+        t.insert(3);
+        t.insert(4);
+        t.insert(5);
+        t.insert(1);
+        t.insert(2);
+        t.insert(6);
+        t.insert(3);
+        t.insert(3);
+        t.insert(8);
+        t.insert(7);
+        t.insert(3);
+        t.insert(3);
 
         assert(t.size() == 12);
 
@@ -438,9 +1555,541 @@ public:
 
         assert(keys == vector<int>({1, 2, 4, 5, 6, 7, 8}));
 
+        // freed nodes are reused
+        size_t pool = t.nodes();
+        t.insert(3);
+        t.insert(3);
+        assert(t.nodes() == pool);
+        assert(getKeys(t) == vector<int>({1, 2, 3, 3, 4, 5, 6, 7, 8}));
+
         cout << "t5 passed" << endl;
     }
 
+    // against a sorted vector, with adversarial increasing priorities
+    static void t6() {
+        Treap<int, int> t;
+        vector<int> keys;
+        for (int i = 0; i < 100000; i++) {
+            int k = rand() % 1000;
+            t.insert(k, i);
+            keys.insert(upper_bound(keys.begin(), keys.end(), k), k);
+
+            if (i % 3 == 0) {
+                int r = rand() % 1000;
+                auto it = lower_bound(keys.begin(), keys.end(), r);
+                bool present = it != keys.end() && *it == r;
+                assert(t.remove(r) == present);
+                if (present) {
+                    keys.erase(it);
+                }
+            }
+        }
+
+        assert(getKeys(t) == keys);
+        for (size_t i = 0; i < keys.size(); i += 97) {
+            assert(t[i] == keys[i]);
+        }
+
+        cout << "t6 passed" << endl;
+    }
+
+    static void t7() {
+        Treap<int, int> t = random(1000, 100);
+        vector<int> keys = getKeys(t);
+
+        for (int key : {-1, 0, 50, 99, 200}) {
+            Treap<int, int> left = t;
+            Treap<int, int> right = left.split(key);
+            vector<int> expected = keys;
+            auto middle = upper_bound(expected.begin(), expected.end(), key);
+            assert(getKeys(left) == vector<int>(expected.begin(), middle));
+            assert(getKeys(right) == vector<int>(middle, expected.end()));
+
+            left.join(move(right));
+            assert(getKeys(left) == keys);
+            assert(right.isEmpty());
+        }
+
+        cout << "t7 passed" << endl;
+    }
+
+    static void t8() {
+        vector<pair<int, int>> sorted;
+        for (int i = 0; i < 10000; i++) {
+            sorted.push_back(make_pair(i / 3, rand()));
+        }
+
+        Treap<int, int> t(sorted.begin(), sorted.end());
+        assert(t.size() == sorted.size());
+        for (size_t i = 0; i < sorted.size(); i += 7) {
+            assert(t[i] == sorted[i].first);
+        }
+
+        // built tree behaves like an inserted one
+        t.removeRange(5);
+        t.insert(5);
+        assert(t.size() == sorted.size() - 2);
+        assert(t[15] == 5 && t[16] == 6);
+
+        Treap<int, int> empty(sorted.end(), sorted.end());
+        assert(empty.isEmpty());
+
+        // from plain sorted keys, runs of equal keys counted in one node
+        vector<int> keys;
+        for (const pair<int, int> &item : sorted) {
+            keys.push_back(item.first);
+        }
+        Treap<int, int> counted(keys.begin(), keys.end(), true);
+        assert(counted.size() == keys.size() && counted.nodes() == 3334);
+        assert(counted.count(7) == 3 && counted[100] == keys[100]);
+        counted.insert(7);
+        assert(counted.nodes() == 3334 && counted.count(7) == 4);
+
+        Treap<int, int> plain(keys.begin(), keys.end(), false);
+        assert(plain.nodes() == keys.size() && getKeys(plain) == keys);
+
+        cout << "t8 passed" << endl;
+    }
+
+    static void t9() {
+        for (int round = 0; round < 50; round++) {
+            int range = 1 + rand() % 200;
+            Treap<int, int> a = random(rand() % 300, range);
+            Treap<int, int> b = random(rand() % 300, range);
+            vector<int> aKeys = getKeys(a);
+            vector<int> bKeys = getKeys(b);
+
+            vector<int> united;
+            merge(aKeys.begin(), aKeys.end(), bKeys.begin(), bKeys.end(), back_inserter(united));
+            vector<int> common;
+            vector<int> difference;
+            for (int key : aKeys) {
+                (binary_search(bKeys.begin(), bKeys.end(), key) ? common : difference).push_back(key);
+            }
+
+            Treap<int, int> u = a;
+            u.unite(Treap<int, int>(b));
+            assert(getKeys(u) == united);
+
+            Treap<int, int> i = a;
+            i.intersect(Treap<int, int>(b));
+            assert(getKeys(i) == common);
+
+            Treap<int, int> d = a;
+            d.subtract(Treap<int, int>(b));
+            assert(getKeys(d) == difference);
+        }
+
+        cout << "t9 passed" << endl;
+    }
+
+    struct Sum {
+        typedef long long Value;
+        static Value identity() { return 0; }
+        static Value combine(Value a, Value b) { return a + b; }
+        static Value repeat(Value x, int k) { return x * k; }
+    };
+
+    struct Min {
+        typedef long long Value;
+        static Value identity() { return numeric_limits<long long>::max(); }
+        static Value combine(Value a, Value b) { return min(a, b); }
+        static Value repeat(Value x, int) { return x; }
+    };
+
+    template <typename Monoid>
+    static vector<long long> getValues(const ImplicitTreap<Monoid> &t) {
+        vector<long long> out;
+        for (size_t i = 0; i < t.size(); i++) {
+            out.push_back(t[i]);
+        }
+        return out;
+    }
+
+    // random edits against a vector
+    static void t10() {
+        vector<long long> reference = {5, 3, 8};
+        ImplicitTreap<Sum> sums(reference.begin(), reference.end());
+        ImplicitTreap<Min> mins(reference.begin(), reference.end());
+
+        for (int step = 0; step < 20000; step++) {
+            size_t n = reference.size();
+            size_t a = rand() % (n + 1);
+            size_t b = rand() % (n + 1);
+            size_t from = min(a, b);
+            size_t to = max(a, b);
+
+            switch (rand() % 7) {
+            case 0:
+            case 1: {
+                long long value = rand() % 1000;
+                reference.insert(reference.begin() + a, value);
+                sums.insert(a, value);
+                mins.insert(a, value);
+                break;
+            }
+            case 2:
+                if (a < n) {
+                    reference.erase(reference.begin() + a);
+                    sums.erase(a);
+                    mins.erase(a);
+                }
+                break;
+            case 3:
+                std::reverse(reference.begin() + from, reference.begin() + to);
+                sums.reverse(from, to);
+                mins.reverse(from, to);
+                break;
+            case 4: {
+                long long value = rand() % 100 - 50;
+                for (size_t i = from; i < to; i++) {
+                    reference[i] += value;
+                }
+                sums.add(from, to, value);
+                mins.add(from, to, value);
+                break;
+            }
+            case 5: {
+                long long sum = 0;
+                long long least = Min::identity();
+                for (size_t i = from; i < to; i++) {
+                    sum += reference[i];
+                    least = min(least, reference[i]);
+                }
+                assert(sums.query(from, to) == sum);
+                assert(mins.query(from, to) == least);
+                break;
+            }
+            default: {
+                ImplicitTreap<Sum> tail = sums.splitAt(a);
+                assert(sums.size() == a && tail.size() == n - a);
+                sums.concat(move(tail));
+                assert(tail.isEmpty());
+                break;
+            }
+            }
+
+            if (step % 1000 == 0) {
+                assert(getValues(sums) == reference);
+                assert(getValues(mins) == reference);
+            }
+        }
+
+        assert(getValues(sums) == reference);
+        cout << "t10 passed" << endl;
+    }
+
+    static void checkOrder(const Treap<int, int> &t, vector<int> keys, int range) {
+        sort(keys.begin(), keys.end());
+        assert(getKeys(t) == keys);
+        assert(vector<int>(reverse_iterator<Treap<int, int>::Iterator>(t.end()), reverse_iterator<Treap<int, int>::Iterator>(t.begin())) ==
+               vector<int>(keys.rbegin(), keys.rend()));
+
+        for (int key = -1; key <= range; key++) {
+            size_t below = lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            size_t notAbove = upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+            assert(t.rank(key) == below);
+            assert(t.count(key) == notAbove - below);
+            assert(t.lower_bound(key).index() == below);
+            assert(t.upper_bound(key).index() == notAbove);
+            if (below < keys.size()) {
+                assert(*t.lower_bound(key) == keys[below]);
+            }
+
+            int hi = key + rand() % 10;
+            size_t inRange = upper_bound(keys.begin(), keys.end(), hi) - keys.begin() - below;
+            assert(t.rangeCount(key, hi) == inRange);
+            if (inRange) {
+                size_t k = rand() % inRange;
+                assert(t.kth(key, hi, k) == keys[below + k]);
+            }
+        }
+
+        // walk back and forth from the middle
+        if (!keys.empty()) {
+            auto it = t.lower_bound(range / 2);
+            size_t i = it.index();
+            for (int step = 0; step < 100 && i > 0; step++) {
+                --it;
+                --i;
+                assert(*it == keys[i]);
+            }
+            for (int step = 0; step < 200 && i + 1 < keys.size(); step++) {
+                ++it;
+                ++i;
+                assert(*it == keys[i]);
+            }
+        }
+    }
+
+    static void t11() {
+        vector<int> keys;
+        Treap<int, int> t;
+        for (int i = 0; i < 5000; i++) {
+            keys.push_back(rand() % 1000);
+            t.insert(keys.back());
+        }
+        checkOrder(t, keys, 1000);
+
+        // increasing priorities make a path, deeper than iterator keeps
+        Treap<int, int> deep;
+        for (int i = 0; i < 300; i++) {
+            deep.insert(i, i);
+        }
+        vector<int> path(300);
+        iota(path.begin(), path.end(), 0);
+        checkOrder(deep, path, 300);
+
+        checkOrder(Treap<int, int>(), vector<int>(), 10);
+
+        cout << "t11 passed" << endl;
+    }
+
+    static void t12() {
+        Treap<int, int> t(true);
+        for (int i = 0; i < 5; i++) {
+            t.insert(3);
+        }
+        t.insert(1);
+        t.insert(5);
+        assert(t.nodes() == 3);
+        assert(t.size() == 7);
+        assert(t.count(3) == 5);
+        assert(getKeys(t) == vector<int>({1, 3, 3, 3, 3, 3, 5}));
+        assert(t[5] == 3 && t[6] == 5);
+        assert(t.rank(5) == 6);
+
+        assert(t.remove(3));
+        assert(t.count(3) == 4 && t.size() == 6 && t.nodes() == 3);
+        assert(t.removeRange(3));
+        assert(getKeys(t) == vector<int>({1, 5}));
+
+        // equal keys of both sides end up in one node
+        Treap<int, int> a(true);
+        Treap<int, int> b(true);
+        vector<int> keys;
+        for (int i = 0; i < 100000; i++) {
+            keys.push_back(rand() % 100);
+            (i % 2 ? a : b).insert(keys.back());
+        }
+        assert(a.nodes() <= 100 && b.nodes() <= 100);
+        a.unite(move(b));
+        sort(keys.begin(), keys.end());
+        assert(getKeys(a) == keys);
+        for (int key = 0; key < 100; key += 7) {
+            assert(a.count(key) == (size_t)(upper_bound(keys.begin(), keys.end(), key) - lower_bound(keys.begin(), keys.end(), key)));
+        }
+        checkOrder(a, keys, 100);
+
+        // split off part keeps counting duplicates
+        Treap<int, int> counting(true);
+        for (int i = 0; i < 10; i++) {
+            counting.insert(i);
+        }
+        Treap<int, int> upper = counting.split(4);
+        assert(upper.nodes() == 5);
+        for (int i = 0; i < 5; i++) {
+            upper.insert(7);
+        }
+        assert(upper.nodes() == 5 && upper.count(7) == 6);
+
+        // priorities from key hashes, same keys give the same shape in any order
+        Treap<int, int> forward(false, TreapPriorities::KEY_HASH, 42);
+        Treap<int, int> backward(false, TreapPriorities::KEY_HASH, 42);
+        Treap<int, int> randomized(false, TreapPriorities::RANDOM, 42);
+        for (int i = 0; i < 1000; i++) {
+            forward.insert(i);
+            backward.insert(999 - i);
+            randomized.insert(i);
+        }
+        vector<int> sortedKeys = getKeys(forward);
+        Treap<int, int> built(sortedKeys.begin(), sortedKeys.end(), false, TreapPriorities::KEY_HASH, 42);
+        bool same = true;
+        for (int i = 0; i < 1000; i++) {
+            assert(forward.depth(i) == backward.depth(i) && forward.depth(i) == built.depth(i));
+            same = same && forward.depth(i) == randomized.depth(i);
+        }
+        assert(!same);
+
+        // and so does the split off part
+        Treap<int, int> hashedUpper = forward.split(500);
+        assert(hashedUpper.size() == 499);
+        vector<int> upperKeys(sortedKeys.begin() + 501, sortedKeys.end());
+        Treap<int, int> builtUpper(upperKeys.begin(), upperKeys.end(), false, TreapPriorities::KEY_HASH, 42);
+        for (int key : {2000, 3000, 4000}) {
+            hashedUpper.insert(key);
+            builtUpper.insert(key);
+        }
+        for (int key : upperKeys) {
+            assert(hashedUpper.depth(key) == builtUpper.depth(key));
+        }
+        for (int key : {2000, 3000, 4000}) {
+            assert(hashedUpper.depth(key) == builtUpper.depth(key));
+        }
+
+        cout << "t12 passed" << endl;
+    }
+
+    // random inserts into a large buffer
+    static void benchmarkRope(int size, int inserts) {
+        vector<long long> buffer(size, 1);
+        ImplicitTreap<Sum> rope(buffer.begin(), buffer.end());
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < inserts; i++) {
+            buffer.insert(buffer.begin() + (i * 7919LL) % buffer.size(), i);
+        }
+        auto vectorTime = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < inserts; i++) {
+            rope.insert((i * 7919LL) % rope.size(), i);
+        }
+        auto ropeTime = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+        assert(rope.query(0, rope.size()) == accumulate(buffer.begin(), buffer.end(), 0LL));
+        cout << inserts << " inserts into " << size << " elements: vector " << vectorTime.count() << " ms, rope " << ropeTime.count() << " ms" << endl;
+    }
+
+    // old versions stay as they were while the current one changes
+    static void t13() {
+        PersistentTreap<int> t;
+        vector<int> keys;
+        vector<PersistentTreap<int>> versions;
+        vector<vector<int>> expected;
+
+        for (int step = 0; step < 20000; step++) {
+            int key = rand() % 500;
+            if (rand() % 3) {
+                t.insert(key);
+                keys.insert(upper_bound(keys.begin(), keys.end(), key), key);
+            } else {
+                auto it = lower_bound(keys.begin(), keys.end(), key);
+                bool present = it != keys.end() && *it == key;
+                assert(t.remove(key) == present);
+                if (present) {
+                    keys.erase(it);
+                }
+            }
+
+            if (step % 1000 == 0) {
+                versions.push_back(t.snapshot());
+                expected.push_back(keys);
+            }
+        }
+
+        assert(t.keys() == keys);
+        for (size_t v = 0; v < versions.size(); v++) {
+            assert(versions[v].keys() == expected[v]);
+            assert(versions[v].size() == expected[v].size());
+            if (!expected[v].empty()) {
+                size_t i = rand() % expected[v].size();
+                assert(versions[v][i] == expected[v][i]);
+                assert(versions[v].rank(expected[v][i]) == size_t(lower_bound(expected[v].begin(), expected[v].end(), expected[v][i]) - expected[v].begin()));
+            }
+        }
+
+        cout << "t13 passed" << endl;
+    }
+
+    // readers take published snapshots and check them while the writer goes on
+    static void t14() {
+        PersistentTreap<int> writer;
+        PersistentTreap<int> published;
+        mutex lock;
+        atomic<bool> done(false);
+
+        vector<thread> readers;
+        atomic<long long> checked(0);
+        for (int r = 0; r < 3; r++) {
+            readers.emplace_back([&]() {
+                while (!done) {
+                    PersistentTreap<int> snapshot;
+                    {
+                        lock_guard<mutex> guard(lock);
+                        snapshot = published;
+                    }
+                    // writer inserts 0, 1, 2, ... so a version of n keys holds exactly them
+                    vector<int> keys = snapshot.keys();
+                    for (size_t i = 0; i < keys.size(); i++) {
+                        assert(keys[i] == (int)i);
+                    }
+                    checked++;
+                }
+            });
+        }
+
+        for (int i = 0; i < 20000; i++) {
+            writer.insert(i);
+            if (i % 100 == 0) {
+                lock_guard<mutex> guard(lock);
+                published = writer.snapshot();
+            }
+        }
+        done = true;
+        for (thread &reader : readers) {
+            reader.join();
+        }
+        assert(writer.size() == 20000);
+
+        cout << "t14 passed, " << checked << " snapshots checked" << endl;
+    }
+
+    // snapshot against full copy of a Treap
+    static void benchmarkSnapshots(int size, int snapshots) {
+        PersistentTreap<int> persistent;
+        Treap<int, int> treap;
+        for (int i = 0; i < size; i++) {
+            int key = (i * 7919LL) % size;
+            persistent.insert(key);
+            treap.insert(key);
+        }
+
+        auto start = chrono::steady_clock::now();
+        vector<PersistentTreap<int>> versions;
+        for (int i = 0; i < snapshots; i++) {
+            versions.push_back(persistent.snapshot());
+            persistent.insert(i);
+        }
+        auto persistentTime = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+        start = chrono::steady_clock::now();
+        vector<Treap<int, int>> copies;
+        for (int i = 0; i < snapshots; i++) {
+            copies.push_back(treap);
+            treap.insert(i);
+        }
+        auto copyTime = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+        assert(versions.back().size() == copies.back().size());
+        cout << snapshots << " snapshots + inserts of " << size << " keys: persistent " << persistentTime.count() << " us, copies " << copyTime.count() << " us" << endl;
+    }
+
+    // sliding window median: every step inserts one value and removes the oldest
+    static void benchmark(int window, int steps) {
+        Treap<int, int> t;
+        deque<int> values;
+        unsigned seed = 1;
+        double checksum = 0;
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < steps; i++) {
+            seed = seed * 1103515245 + 12345;
+            int v = (seed >> 8) % 1000000;
+            t.insert(v);
+            values.push_back(v);
+
+            if ((int)values.size() > window) {
+                t.remove(values.front());
+                values.pop_front();
+            }
+            checksum += median(t);
+        }
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+
+        cout << "sliding median, window " << window << ", " << steps << " steps: " << elapsed.count() << " ms, checksum " << checksum << endl;
+    }
+
 
     static void main() {
         t1();
@@ -448,6 +2097,19 @@ public:
         t3();
         t4();
         t5();
+        t6();
+        t7();
+        t8();
+        t9();
+        t10();
+        t11();
+        t12();
+        t13();
+        t14();
+
+        benchmark(1000, 1000000);
+        benchmarkRope(1000000, 2000);
+        benchmarkSnapshots(1000000, 20);
 
         cout << "cool!" << endl;
     }